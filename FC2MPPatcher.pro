@@ -2,7 +2,10 @@ TEMPLATE = subdirs
 
 SUBDIRS += \
     libpebliss \
-    app
+    app \
+    bench \
+    check \
+    fixture
 
 win32 {
     SUBDIRS += libpatch
@@ -11,7 +14,13 @@ win32 {
 # Where to find the sub projects - give the folders
 libpebliss.subdir = lib/libpebliss
 app.subdir = src/app
+bench.subdir = src/bench
+check.subdir = src/check
+fixture.subdir = src/fixture
 libpatch.subdir = src/libpatch
 
 # What subproject depends on others
 app.depends = libpebliss
+bench.depends = libpebliss
+check.depends = libpebliss
+fixture.depends = libpebliss
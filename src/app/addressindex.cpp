@@ -0,0 +1,52 @@
+#include <algorithm>
+
+#include "addressindex.h"
+
+void AddressIndex::clear()
+{
+    ranges.clear();
+}
+
+void AddressIndex::insert(int section, quint32 virtualAddress, quint32 size, qint64 fileOffset)
+{
+    if (size == 0) {
+        return;
+    }
+
+    Range range { virtualAddress, size, fileOffset, section };
+
+    // Keep the table sorted, images only have a handful of sections so inserting in place is cheap.
+    QVector<Range>::iterator iterator = std::upper_bound(ranges.begin(), ranges.end(), virtualAddress, [](quint32 address, const Range &other) {
+        return address < other.virtualAddress;
+    });
+
+    ranges.insert(iterator, range);
+}
+
+AddressIndex::Location AddressIndex::find(quint32 rva, quint32 length) const
+{
+    Location location;
+
+    // Last range starting at or before the address.
+    QVector<Range>::const_iterator iterator = std::upper_bound(ranges.cbegin(), ranges.cend(), rva, [](quint32 address, const Range &range) {
+        return address < range.virtualAddress;
+    });
+
+    if (length == 0 || iterator == ranges.cbegin()) {
+        return location;
+    }
+
+    const Range &range = *(iterator - 1);
+    quint32 offset = rva - range.virtualAddress;
+
+    // The whole write has to stay within a single section.
+    if (offset >= range.size || length > range.size - offset) {
+        return location;
+    }
+
+    location.section = range.section;
+    location.offset = offset;
+    location.fileOffset = range.fileOffset >= 0 ? range.fileOffset + offset : -1;
+
+    return location;
+}
@@ -0,0 +1,35 @@
+#ifndef ADDRESSINDEX_H
+#define ADDRESSINDEX_H
+
+#include <QVector>
+
+// Sorted interval table over the sections of an image, translates RVAs to section and file offsets in O(log n).
+class AddressIndex
+{
+public:
+    struct Location {
+        int section = -1;     // Index of the section as it was inserted.
+        quint32 offset = 0;   // Offset from the start of the section.
+        qint64 fileOffset = -1;
+
+        bool isValid() const {
+            return section >= 0;
+        }
+    };
+
+    void clear();
+    void insert(int section, quint32 virtualAddress, quint32 size, qint64 fileOffset = -1);
+    Location find(quint32 rva, quint32 length) const;
+
+private:
+    struct Range {
+        quint32 virtualAddress;
+        quint32 size;
+        qint64 fileOffset;
+        int section;
+    };
+
+    QVector<Range> ranges;
+};
+
+#endif // ADDRESSINDEX_H
@@ -1,4 +1,4 @@
-QT += network
+QT += network concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -19,19 +19,44 @@ DEFINES += QT_DEPRECATED_WARNINGS
 # You can also select to disable deprecated APIs only up to a certain version of Qt.
 DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# Signature scanning compares 16 bytes at a time, 32-bit x86 targets do not enable SSE2 by default.
+QMAKE_CXXFLAGS += $$QMAKE_CFLAGS_SSE2
+
 HEADERS += \
+    addressindex.h \
+    commandline.h \
+    delta.h \
     dirutils.h \
     fileutils.h \
+    hashstreambuffer.h \
+    importindex.h \
+    memorystreambuffer.h \
+    outputcache.h \
     patcher.h \
+    patchplan.h \
+    patchprogress.h \
     pefile.h \
+    peheader.h \
+    signaturescanner.h \
     widget.h
 
 SOURCES += \
+    addressindex.cpp \
+    commandline.cpp \
+    delta.cpp \
     dirutils.cpp \
     fileutils.cpp \
+    hashstreambuffer.cpp \
+    importindex.cpp \
     main.cpp \
+    memorystreambuffer.cpp \
+    outputcache.cpp \
     patcher.cpp \
+    patchplan.cpp \
+    patchprogress.cpp \
     pefile.cpp \
+    peheader.cpp \
+    signaturescanner.cpp \
     widget.cpp
 
 FORMS += widget.ui
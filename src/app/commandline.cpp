@@ -0,0 +1,327 @@
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSettings>
+#include <QTextStream>
+
+#include "commandline.h"
+#include "global.h"
+#include "dirutils.h"
+#include "fileutils.h"
+#include "delta.h"
+#include "patchdatabase.h"
+#include "pefile.h"
+
+constexpr char commandline_option_patch[] = "patch";
+constexpr char commandline_option_undo[] = "undo";
+constexpr char commandline_option_dir[] = "dir";
+constexpr char commandline_option_interface[] = "interface";
+constexpr char commandline_option_verify[] = "verify";
+constexpr char commandline_option_json[] = "json";
+constexpr char commandline_option_create_delta[] = "create-delta";
+constexpr char commandline_option_export_database[] = "export-database";
+constexpr char commandline_option_discover[] = "discover";
+constexpr char commandline_verify_checksum[] = "checksum";
+constexpr char commandline_verify_sites[] = "sites";
+
+bool CommandLine::isRequested(int argc, char *argv[])
+{
+    // Decided before any application object exists, so look at the raw arguments.
+    for (int i = 1; i < argc; i++) {
+        QString argument = QString::fromLocal8Bit(argv[i]);
+
+        if (argument == QString("--%1").arg(commandline_option_patch) ||
+            argument == QString("--%1").arg(commandline_option_undo) ||
+            argument == QString("--%1").arg(commandline_option_create_delta) ||
+            argument == QString("--%1").arg(commandline_option_export_database) ||
+            argument == QString("--%1").arg(commandline_option_discover)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int CommandLine::exec(const QCoreApplication &app)
+{
+    QCommandLineParser parser;
+    parser.setApplicationDescription(QString("Patches %1 for multiplayer without showing the GUI.").arg(game_name));
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption({ commandline_option_patch, "Install the patch." });
+    parser.addOption({ commandline_option_undo, "Uninstall the patch." });
+    parser.addOption({ commandline_option_dir, "Game installation directory.", "path" });
+    parser.addOption({ commandline_option_interface, "Network interface to use, by index or name.", "index|name" });
+    parser.addOption({ commandline_option_verify, "How to verify game files, \"checksum\" or \"sites\", defaults to the verificationMode setting.", "mode" });
+    parser.addOption({ commandline_option_json, "Print results as JSON." });
+    parser.addOption({ commandline_option_create_delta, "Create a delta from an original to a patched file." });
+    parser.addOption({ commandline_option_export_database, "Write the patch tables in effect to a patch database file.", "file" });
+    parser.addOption({ commandline_option_discover, "List the call sites of the replaced network functions in a game file as patch table entries.", "file" });
+    parser.addPositionalArgument("original", "Original file, with --create-delta.", "[original]");
+    parser.addPositionalArgument("patched", "Patched file, with --create-delta.", "[patched]");
+    parser.process(app);
+
+    QTextStream output(stdout);
+    QTextStream error(stderr);
+
+    if (parser.isSet(commandline_option_create_delta)) {
+        if (parser.positionalArguments().length() != 2) {
+            error << QT_TR_NOOP("Error: --create-delta needs an original and a patched file.") << '\n';
+
+            return 2;
+        }
+
+        QString originalFileName = parser.positionalArguments().at(0);
+        QString deltaFileName = Delta::getFileName(FileUtils::checkSum(originalFileName));
+
+        if (!Delta::create(originalFileName, parser.positionalArguments().at(1), deltaFileName)) {
+            error << QT_TR_NOOP(QString("Error: Could not create delta %1").arg(deltaFileName)) << '\n';
+
+            return 1;
+        }
+
+        output << deltaFileName << '\n';
+
+        return 0;
+    }
+
+    if (parser.isSet(commandline_option_export_database)) {
+        QString databaseFileName = parser.value(commandline_option_export_database);
+
+        if (!PatchDatabase::write(databaseFileName, PatchDatabase::getFiles())) {
+            error << QT_TR_NOOP(QString("Error: Could not write patch database %1").arg(databaseFileName)) << '\n';
+
+            return 1;
+        }
+
+        output << databaseFileName << '\n';
+
+        return 0;
+    }
+
+    if (parser.isSet(commandline_option_discover)) {
+        QFile file(parser.value(commandline_option_discover));
+
+        if (!file.exists()) {
+            error << QT_TR_NOOP(QString("Error: %1 does not exist.").arg(file.fileName())) << '\n';
+
+            return 2;
+        }
+
+        PeFile peFile(file);
+        const QList<CodeEntry> &codeEntries = peFile.findCallSites(patch_library_original_functions);
+
+        // Printed the way the patch tables in global.h are written, so they can be pasted as is.
+        for (const CodeEntry &codeEntry : codeEntries) {
+            QString function = patch_library_original_functions[codeEntry.getData().toInt()].second;
+            QString section = codeEntry.getSection() != ".text" ? QString(" in %1").arg(codeEntry.getSection()) : QString();
+
+            output << QString("{ 0x%1, %2 }, // %3()%4").arg(codeEntry.getAddress(), 8, 16, QChar('0')).arg(codeEntry.getData().constData()).arg(function).arg(section) << '\n';
+        }
+
+        return codeEntries.isEmpty() ? 1 : 0;
+    }
+
+    bool undo = parser.isSet(commandline_option_undo);
+    bool json = parser.isSet(commandline_option_json);
+
+    if (parser.isSet(commandline_option_patch) == undo) {
+        error << QT_TR_NOOP("Error: Exactly one of --patch or --undo must be given.") << '\n';
+
+        return 2;
+    }
+
+    QString path = parser.value(commandline_option_dir);
+
+    if (!DirUtils::isGameDirectory(path)) {
+        error << QT_TR_NOOP(QString("Error: %1 is not a %2 installation directory.").arg(path).arg(game_name)) << '\n';
+
+        return 2;
+    }
+
+    QNetworkInterface networkInterface;
+
+    if (!undo) {
+        networkInterface = findInterface(parser.value(commandline_option_interface));
+
+        if (!networkInterface.isValid()) {
+            error << QT_TR_NOOP(QString("Error: Network interface \"%1\" not found.").arg(parser.value(commandline_option_interface))) << '\n';
+
+            return 2;
+        }
+    }
+
+    if (parser.isSet(commandline_option_verify)) {
+        QString mode = parser.value(commandline_option_verify);
+
+        if (mode != commandline_verify_checksum && mode != commandline_verify_sites) {
+            error << QT_TR_NOOP(QString("Error: Unknown verification mode \"%1\".").arg(mode)) << '\n';
+
+            return 2;
+        }
+
+        if (mode == commandline_verify_sites) {
+            FileUtils::setVerificationMode(VerificationMode::PatchSites);
+        }
+    } else if (QSettings(app_configuration_file, QSettings::IniFormat).value(settings_verification_mode).toString() == settings_verification_mode_patch_sites) {
+        // Same setting the GUI reads in Widget::loadSettings().
+        FileUtils::setVerificationMode(VerificationMode::PatchSites);
+    }
+
+    // Same directory handling as the GUI, accept both the install and the executable directory.
+    QDir dir = path;
+
+    if (dir.dirName() != game_executable_directory) {
+        dir.cd(game_executable_directory);
+    }
+
+    // Finish or roll back a patch that was interrupted last time.
+    Patcher::recover(dir);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    PatchReport report;
+    bool success = true;
+
+    if (undo) {
+        // Files without a backup are reported as not patched, so this is safe on a clean install too.
+        success = Patcher::undoPatch(dir, &report);
+    } else if (!Patcher::isPatched(dir.absolutePath())) {
+        success = Patcher::patch(dir, &report);
+
+        if (success) {
+            Patcher::generateConfigurationFile(dir, networkInterface);
+        }
+    } else {
+        for (const FileEntry &fileEntry : PatchDatabase::getFiles()) {
+            report.files.append(getFileReport(dir, fileEntry));
+        }
+
+        // Still regenerate configuration, the interface may have changed.
+        Patcher::generateConfigurationFile(dir, networkInterface);
+    }
+
+    qint64 elapsed = timer.nsecsElapsed();
+
+    if (json) {
+        QJsonObject result = toJson(report);
+        result.insert("directory", dir.absolutePath());
+        result.insert("action", undo ? commandline_option_undo : commandline_option_patch);
+        result.insert("success", success);
+        result.insert("totalMs", elapsed / 1000000.0);
+
+        if (!undo) {
+            result.insert("interface", networkInterface.name());
+        }
+
+        output << QJsonDocument(result).toJson();
+    } else {
+        for (const FileReport &fileReport : report.files) {
+            output << QString("%1: %2 %3").arg(fileReport.fileName).arg(toString(fileReport.status)).arg(fileReport.target) << '\n';
+        }
+
+        if (!success) {
+            error << report.error << '\n';
+        }
+    }
+
+    return success ? 0 : 1;
+}
+
+QNetworkInterface CommandLine::findInterface(const QString &value)
+{
+    bool isIndex = false;
+    int index = value.toInt(&isIndex);
+
+    if (isIndex) {
+        return QNetworkInterface::interfaceFromIndex(index);
+    }
+
+    for (const QNetworkInterface &networkInterface : QNetworkInterface::allInterfaces()) {
+        if (networkInterface.name() == value || networkInterface.humanReadableName() == value) {
+            return networkInterface;
+        }
+    }
+
+    return QNetworkInterface();
+}
+
+FileReport CommandLine::getFileReport(const QDir &dir, const FileEntry &fileEntry)
+{
+    FileReport fileReport;
+    fileReport.fileName = fileEntry.getName();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    TargetMatch match = FileUtils::identify(dir, fileEntry);
+    fileReport.timings.append({ "identify", timer.nsecsElapsed() });
+
+    if (match.isValid()) {
+        fileReport.target = fileEntry.getTargets().at(match.index).getName();
+        fileReport.status = match.patched ? FileReport::ALREADY_PATCHED : FileReport::NOT_PATCHED;
+    } else if (QFile::exists(FileUtils::appendToName(dir, fileEntry, game_backup_suffix))) {
+        // Patched by a build whose checksums are not known any more, the backup still tells.
+        fileReport.status = FileReport::ALREADY_PATCHED;
+    }
+
+    return fileReport;
+}
+
+QJsonObject CommandLine::toJson(const PatchReport &report)
+{
+    QJsonArray files;
+
+    for (const FileReport &fileReport : report.files) {
+        QJsonObject timings;
+
+        for (const QPair<QString, qint64> &timing : fileReport.timings) {
+            timings.insert(timing.first + "Ms", timing.second / 1000000.0);
+        }
+
+        QJsonObject file;
+        file.insert("name", fileReport.fileName);
+        file.insert("target", fileReport.target);
+        file.insert("status", toString(fileReport.status));
+        file.insert("timings", timings);
+        files.append(file);
+    }
+
+    QJsonObject result;
+    result.insert("files", files);
+
+    if (!report.error.isEmpty()) {
+        result.insert("error", report.error);
+    }
+
+    return result;
+}
+
+QString CommandLine::toString(FileReport::Status status)
+{
+    switch (status) {
+    case FileReport::ALREADY_PATCHED:
+        return "alreadyPatched";
+
+    case FileReport::PATCHED:
+        return "patched";
+
+    case FileReport::FAILED:
+        return "failed";
+
+    case FileReport::CANCELED:
+        return "canceled";
+
+    case FileReport::RESTORED:
+        return "restored";
+
+    case FileReport::NOT_PATCHED:
+        return "notPatched";
+
+    default:
+        return "unknown";
+    }
+}
@@ -0,0 +1,27 @@
+#ifndef COMMANDLINE_H
+#define COMMANDLINE_H
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QNetworkInterface>
+#include <QJsonObject>
+#include <QString>
+
+#include "patcher.h"
+
+// Headless mode, patches or unpatches an install without showing any GUI.
+class CommandLine
+{
+public:
+    static bool isRequested(int argc, char *argv[]);
+    static int exec(const QCoreApplication &app);
+
+private:
+    static QNetworkInterface findInterface(const QString &value);
+    static FileReport getFileReport(const QDir &dir, const FileEntry &fileEntry);
+    static QJsonObject toJson(const PatchReport &report);
+    static QString toString(FileReport::Status status);
+};
+
+#endif // COMMANDLINE_H
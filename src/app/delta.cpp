@@ -0,0 +1,261 @@
+#include <cstring>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QCryptographicHash>
+#include <QDebug>
+
+#include "delta.h"
+#include "fileutils.h"
+#include "global.h"
+
+constexpr quint32 delta_magic = 0x4c444346; // "FCDL"
+constexpr quint32 delta_version = 1;
+constexpr quint8 delta_operation_copy = 0;
+constexpr quint8 delta_operation_add = 1;
+constexpr int delta_block_size = 32;
+constexpr quint32 delta_hash_multiplier = 0x01000193;
+
+bool Delta::create(const QString &originalFileName, const QString &patchedFileName, const QString &deltaFileName)
+{
+    QFile originalFile(originalFileName);
+    QFile patchedFile(patchedFileName);
+
+    if (!originalFile.open(QFile::ReadOnly) || !patchedFile.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 originalSize = originalFile.size();
+    const qint64 patchedSize = patchedFile.size();
+    const uchar *original = originalSize > 0 ? originalFile.map(0, originalSize) : nullptr;
+    const uchar *patched = patchedSize > 0 ? patchedFile.map(0, patchedSize) : nullptr;
+
+    if ((originalSize > 0 && !original) || (patchedSize > 0 && !patched)) {
+        return false;
+    }
+
+    // Weight of the byte leaving the rolling hash window.
+    quint32 outgoingWeight = 1;
+
+    for (int i = 1; i < delta_block_size; i++) {
+        outgoingWeight *= delta_hash_multiplier;
+    }
+
+    auto hashBlock = [](const uchar *data) {
+        quint32 hash = 0;
+
+        for (int i = 0; i < delta_block_size; i++) {
+            hash = hash * delta_hash_multiplier + data[i];
+        }
+
+        return hash;
+    };
+
+    // Index every aligned block of the original, the first occurrence wins.
+    QHash<quint32, qint64> blocks;
+
+    for (qint64 offset = 0; offset + delta_block_size <= originalSize; offset += delta_block_size) {
+        quint32 hash = hashBlock(original + offset);
+
+        if (!blocks.contains(hash)) {
+            blocks.insert(hash, offset);
+        }
+    }
+
+    QDir().mkpath(QFileInfo(deltaFileName).absolutePath());
+    QSaveFile deltaFile(deltaFileName);
+
+    if (!deltaFile.open(QFile::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&deltaFile);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << delta_magic << delta_version;
+    stream << QByteArray::fromRawData(reinterpret_cast<const char*>(FileUtils::checkSum(originalFileName).data()), sizeof(CheckSum));
+    stream << QByteArray::fromRawData(reinterpret_cast<const char*>(FileUtils::checkSum(patchedFileName).data()), sizeof(CheckSum));
+    stream << patchedSize;
+
+    qint64 addStart = 0;
+    qint64 position = 0;
+    quint32 hash = patchedSize >= delta_block_size ? hashBlock(patched) : 0;
+
+    auto flushAdd = [&stream, patched, &addStart](qint64 end) {
+        if (end > addStart) {
+            stream << delta_operation_add << QByteArray::fromRawData(reinterpret_cast<const char*>(patched + addStart), end - addStart);
+        }
+    };
+
+    // Slide over the patched file, every window found in the original becomes a copy grown as far as it matches.
+    while (position + delta_block_size <= patchedSize) {
+        QHash<quint32, qint64>::const_iterator iterator = blocks.constFind(hash);
+
+        if (iterator != blocks.constEnd() && std::memcmp(original + iterator.value(), patched + position, delta_block_size) == 0) {
+            qint64 start = position;
+            qint64 source = iterator.value();
+
+            while (start > addStart && source > 0 && patched[start - 1] == original[source - 1]) {
+                start--;
+                source--;
+            }
+
+            qint64 length = position - start + delta_block_size;
+
+            while (start + length < patchedSize && source + length < originalSize && patched[start + length] == original[source + length]) {
+                length++;
+            }
+
+            flushAdd(start);
+            stream << delta_operation_copy << source << length;
+            position = start + length;
+            addStart = position;
+
+            if (position + delta_block_size <= patchedSize) {
+                hash = hashBlock(patched + position);
+            }
+
+            continue;
+        }
+
+        if (position + delta_block_size >= patchedSize) {
+            break;
+        }
+
+        hash = (hash - patched[position] * outgoingWeight) * delta_hash_multiplier + patched[position + delta_block_size];
+        position++;
+    }
+
+    flushAdd(patchedSize);
+
+    if (stream.status() != QDataStream::Ok || !deltaFile.commit()) {
+        return false;
+    }
+
+    qDebug().noquote() << QT_TR_NOOP(QString("Created delta from %1 to %2, saved to: %3").arg(originalFileName).arg(patchedFileName).arg(deltaFileName));
+
+    return true;
+}
+
+bool Delta::apply(const QString &deltaFileName, const QString &fileName, const CheckSum &checkSumPatched, const QString &outputFileName, PatchProgress *progress)
+{
+    QFile deltaFile(deltaFileName);
+
+    if (!deltaFile.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&deltaFile);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    QByteArray checkSumOriginal;
+    QByteArray checkSumResult;
+    qint64 resultSize = 0;
+    stream >> magic >> version >> checkSumOriginal >> checkSumResult >> resultSize;
+
+    if (stream.status() != QDataStream::Ok || magic != delta_magic || version != delta_version || FileUtils::toCheckSum(checkSumResult) != checkSumPatched) {
+        return false;
+    }
+
+    // Copies only make sense against the exact file the delta was created from.
+    if (FileUtils::toCheckSum(checkSumOriginal) != FileUtils::checkSum(fileName)) {
+        qDebug().noquote() << QT_TR_NOOP(QString("Error: Delta %1 was not created from: %2").arg(deltaFileName).arg(fileName));
+
+        return false;
+    }
+
+    QFile sourceFile(fileName);
+
+    if (!sourceFile.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    const qint64 sourceSize = sourceFile.size();
+    const uchar *source = sourceSize > 0 ? sourceFile.map(0, sourceSize) : nullptr;
+
+    if (sourceSize > 0 && !source) {
+        return false;
+    }
+
+    // The result is hashed while it is written and only replaces the original, or becomes the output file, when it matches.
+    QSaveFile outputFile(outputFileName.isEmpty() ? fileName : outputFileName);
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    qint64 written = 0;
+
+    if (!outputFile.open(QFile::WriteOnly)) {
+        return false;
+    }
+
+    auto write = [&outputFile, &hash, &written, progress](const char *data, qint64 length) {
+        // Copies can span most of the file, write them in chunks so progress keeps moving.
+        constexpr qint64 chunkSize = 4 * 1024 * 1024;
+
+        for (qint64 offset = 0; offset < length; offset += chunkSize) {
+            qint64 chunkLength = qMin(chunkSize, length - offset);
+            hash.addData(data + offset, static_cast<int>(chunkLength));
+            written += chunkLength;
+
+            if (outputFile.write(data + offset, chunkLength) != chunkLength) {
+                return false;
+            }
+
+            if (progress) {
+                progress->addBytesWritten(chunkLength);
+            }
+        }
+
+        return true;
+    };
+
+    bool success = true;
+
+    while (success && !stream.atEnd()) {
+        quint8 operation = 0;
+        stream >> operation;
+
+        if (operation == delta_operation_copy) {
+            qint64 offset = 0;
+            qint64 length = 0;
+            stream >> offset >> length;
+
+            success = stream.status() == QDataStream::Ok && offset >= 0 && length > 0 && length <= sourceSize - offset && written + length <= resultSize &&
+                      write(reinterpret_cast<const char*>(source + offset), length);
+        } else if (operation == delta_operation_add) {
+            QByteArray data;
+            stream >> data;
+
+            success = stream.status() == QDataStream::Ok && written + data.length() <= resultSize && write(data.constData(), data.length());
+        } else {
+            success = false;
+        }
+    }
+
+    // Let go of the original before it gets replaced.
+    sourceFile.unmap(const_cast<uchar*>(source));
+    sourceFile.close();
+
+    if (!success || written != resultSize || FileUtils::toCheckSum(hash.result()) != checkSumPatched) {
+        qDebug().noquote() << QT_TR_NOOP(QString("Error: Delta %1 did not produce the expected file, keeping: %2").arg(deltaFileName).arg(fileName));
+        outputFile.cancelWriting();
+
+        return false;
+    }
+
+    if (!outputFile.commit()) {
+        return false;
+    }
+
+    qDebug().noquote() << QT_TR_NOOP(QString("Applied delta %1 to: %2").arg(deltaFileName).arg(outputFileName.isEmpty() ? fileName : outputFileName));
+
+    return true;
+}
+
+QString Delta::getFileName(const CheckSum &checkSum)
+{
+    return QDir(app_delta_directory).filePath(FileUtils::toHex(checkSum) + app_delta_suffix);
+}
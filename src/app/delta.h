@@ -0,0 +1,19 @@
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <QString>
+
+#include "checksum.h"
+#include "patchprogress.h"
+
+// Binary delta from an original file straight to its patched form.
+// A delta is a stream of COPY (range of the original) and ADD (literal bytes) operations, applied in one pass.
+class Delta
+{
+public:
+    static bool create(const QString &originalFileName, const QString &patchedFileName, const QString &deltaFileName);
+    static bool apply(const QString &deltaFileName, const QString &fileName, const CheckSum &checkSumPatched, const QString &outputFileName = QString(), PatchProgress *progress = nullptr);
+    static QString getFileName(const CheckSum &checkSum);
+};
+
+#endif // DELTA_H
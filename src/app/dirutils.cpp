@@ -6,6 +6,7 @@
 
 #include "dirutils.h"
 #include "global.h"
+#include "patchdatabase.h"
 
 QStringList DirUtils::installDirectories;
 
@@ -13,7 +14,7 @@ bool DirUtils::isGameDirectory(QDir dir)
 {
     // Trying change to execuatable directory, assuming we're in install directory or that we already is in it.
     if (dir.exists() | dir.cd(game_executable_directory)) {
-        for (const FileEntry &file : files) {
+        for (const FileEntry &file : PatchDatabase::getFiles()) {
             // TODO: Check against checksum here?
             if (dir.exists(file.getName())) {
                 return true;
@@ -1,29 +1,427 @@
+#include <algorithm>
+#include <cstring>
+
 #include <QCryptographicHash>
 #include <QStringList>
 #include <QDebug>
+#include <QSettings>
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QtConcurrent>
+#include <QtEndian>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <io.h>
+#else
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef Q_OS_LINUX
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 
 #include "fileutils.h"
+#include "signaturescanner.h"
 #include "global.h"
+#include "patchdatabase.h"
+
+VerificationMode FileUtils::verificationMode = VerificationMode::CheckSum;
+bool FileUtils::checkSumCacheEnabled = true;
+QMutex FileUtils::checkSumCacheMutex;
 
-const char *FileUtils::checkSum(QFile file)
+void FileUtils::setVerificationMode(VerificationMode mode)
 {
+    verificationMode = mode;
+}
+
+VerificationMode FileUtils::getVerificationMode()
+{
+    return verificationMode;
+}
+
+void FileUtils::setCheckSumCacheEnabled(bool enabled)
+{
+    checkSumCacheEnabled = enabled;
+}
+
+CheckSum FileUtils::checkSum(QFile file, PatchProgress *progress)
+{
+    QFileInfo fileInfo = file;
+    CheckSum result {};
+
+    // Skip hashing if this exact file was hashed before.
+    if (readCheckSumCache(fileInfo, result)) {
+        if (progress) {
+            progress->addBytesHashed(fileInfo.size());
+        }
+
+        return result;
+    }
+
     if (file.open(QFile::ReadOnly)) {
         QCryptographicHash hash(QCryptographicHash::Sha256);
-        hash.addData(&file);
+        qint64 size = file.size();
+        uchar *data = size > 0 ? file.map(0, size) : nullptr;
+
+        if (data) {
+            // Hash straight from the page cache, addData() only takes int lengths so feed it in chunks.
+            constexpr qint64 chunkSize = 4 * 1024 * 1024;
+
+            for (qint64 offset = 0; offset < size; offset += chunkSize) {
+                // Give up half way, the partial digest is useless.
+                if (progress && progress->isCanceled()) {
+                    return CheckSum {};
+                }
+
+                qint64 length = qMin(chunkSize, size - offset);
+                hash.addData(reinterpret_cast<const char*>(data + offset), static_cast<int>(length));
+
+                if (progress) {
+                    progress->addBytesHashed(length);
+                }
+            }
+
+            file.unmap(data);
+        } else {
+            hash.addData(&file);
+
+            if (progress) {
+                progress->addBytesHashed(size);
+            }
+        }
+
         file.close();
 
-        return hash.result().toHex().constData();
+        result = toCheckSum(hash.result());
+        writeCheckSumCache(fileInfo, result);
     }
 
-    return nullptr;
+    // An all zero checksum never matches any target.
+    return result;
 }
 
 bool FileUtils::isValid(const QDir &dir, const FileEntry &fileEntry, const TargetEntry &target, bool patched)
 {
-    const char *fileCheckSum = checkSum(dir.filePath(fileEntry.getName()));
-    const char *targetCheckSum = patched ? target.getCheckSumPatched() : target.getCheckSum();
+    return isValid(dir.filePath(fileEntry.getName()), target, patched);
+}
+
+bool FileUtils::isValid(const QString &fileName, const TargetEntry &target, bool patched)
+{
+    if (verificationMode == VerificationMode::PatchSites) {
+        return isValidBySites(fileName, target, patched);
+    }
+
+    return checkSum(fileName) == (patched ? target.getCheckSumPatched() : target.getCheckSum());
+}
+
+QFuture<CheckSum> FileUtils::checkSumAsync(const QString &fileName)
+{
+    return QtConcurrent::run([fileName] {
+        return checkSum(fileName);
+    });
+}
+
+void FileUtils::cacheCheckSum(const QString &fileName, const CheckSum &checkSum)
+{
+    writeCheckSumCache(QFileInfo(fileName), checkSum);
+}
+
+CheckSum FileUtils::toCheckSum(const QByteArray &digest)
+{
+    CheckSum checkSum {};
+
+    if (digest.length() == static_cast<int>(checkSum.size())) {
+        std::memcpy(checkSum.data(), digest.constData(), checkSum.size());
+    }
+
+    return checkSum;
+}
+
+QByteArray FileUtils::toHex(const CheckSum &checkSum)
+{
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(checkSum.data()), checkSum.size()).toHex();
+}
+
+TargetMatch FileUtils::identify(const QDir &dir, const FileEntry &fileEntry, PatchProgress *progress)
+{
+    QString fileName = dir.filePath(fileEntry.getName());
+
+    if (verificationMode == VerificationMode::PatchSites) {
+        const QList<TargetMatch> &matches = identifyBySites(fileName, fileEntry);
+        bool patched = !matches.isEmpty() && std::all_of(matches.cbegin(), matches.cend(), [](const TargetMatch &match) {
+            return match.patched;
+        });
+
+        // Editions sharing every patch site cannot be told apart by them, which matters only when patching, then the full checksum decides.
+        if (matches.length() <= 1 || patched) {
+            return matches.isEmpty() ? TargetMatch() : matches.first();
+        }
+    }
+
+    // Hash the file once and look up which target, if any, it belongs to.
+    const std::unordered_map<CheckSum, TargetMatch, CheckSumHash> &checkSums = getCheckSumIndex(fileEntry);
+    std::unordered_map<CheckSum, TargetMatch, CheckSumHash>::const_iterator iterator = checkSums.find(checkSum(fileName, progress));
+
+    return iterator != checkSums.end() ? iterator->second : TargetMatch();
+}
+
+QFuture<TargetMatch> FileUtils::identifyAsync(const QDir &dir, const FileEntry &fileEntry)
+{
+    return QtConcurrent::run([dir, fileEntry] {
+        return identify(dir, fileEntry);
+    });
+}
+
+QList<TargetMatch> FileUtils::identifyBySites(const QString &fileName, const FileEntry &fileEntry)
+{
+    QFile file(fileName);
+    QList<TargetMatch> matches;
+
+    if (!file.open(QFile::ReadOnly)) {
+        return matches;
+    }
+
+    // Mapping is lazy, only the pages holding the patch sites are ever read.
+    PeHeader header(&file);
+    uchar *data = header.isValid() ? file.map(0, file.size()) : nullptr;
+
+    if (data) {
+        const QList<TargetEntry> &targets = fileEntry.getTargets();
+
+        // Every target is tried, more than one may match.
+        for (int i = 0; i < targets.length(); i++) {
+            if (verifySites(header, data, targets[i], true)) {
+                matches.append({ i, true });
+            } else if (verifySites(header, data, targets[i], false)) {
+                matches.append({ i, false });
+            }
+        }
+
+        file.unmap(data);
+    }
+
+    file.close();
+
+    return matches;
+}
+
+bool FileUtils::isValidBySites(const QString &fileName, const TargetEntry &target, bool patched)
+{
+    QFile file(fileName);
+
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    PeHeader header(&file);
+    uchar *data = header.isValid() ? file.map(0, file.size()) : nullptr;
+    bool result = false;
+
+    if (data) {
+        result = verifySites(header, data, target, patched);
+        file.unmap(data);
+    }
+
+    file.close();
+
+    return result;
+}
+
+bool FileUtils::verifySites(const PeHeader &header, const uchar *data, const TargetEntry &target, bool patched)
+{
+    quint32 libraryAddress = getImportAddressTable(header, data, patch_library_file);
+
+    // An original file must not import the patch library, a patched one must.
+    if (patched != (libraryAddress != 0)) {
+        return false;
+    }
+
+    auto bytesAt = [&](quint32 address, int length) {
+        qint64 offset = header.vaToFileOffset(address, length);
+
+        return offset < 0 ? QByteArray() : QByteArray::fromRawData(reinterpret_cast<const char*>(data + offset), length);
+    };
+
+    quint32 iatAddress = header.getImageBase() + header.getDirectoryRva(PeHeader::DIRECTORY_IAT);
+    quint32 iatSize = header.getDirectorySize(PeHeader::DIRECTORY_IAT);
+    QList<CodeEntry> codeEntries = target.getCodeEntries();
+    QByteArray textData;
+
+    // The same sites PeFile::patchCode() locates, a signature that is not found means this is not the target.
+    if (!resolveSites(header, data, codeEntries)) {
+        return false;
+    }
+
+    for (const CodeEntry &codeEntry : codeEntries) {
+        QByteArray codeData = codeEntry.getData();
+
+        if (codeEntry.getType() == CodeEntry::NEW_DATA) {
+            textData.append(codeData);
+
+            continue;
+        }
+
+        // If address is zero, that means this entry is not patched for this file.
+        if (codeEntry.getAddress() == 0) {
+            continue;
+        }
+
+        switch (codeEntry.getType()) {
+        case CodeEntry::INJECT_SYMBOL:
+            {
+                QByteArray bytes = bytesAt(codeEntry.getAddress(), sizeof(quint32));
+
+                if (bytes.isEmpty()) {
+                    return false;
+                }
+
+                quint32 value = qFromLittleEndian<quint32>(bytes.constData());
+
+                if (patched) {
+                    // Must point at the import slot of the patch function.
+                    if (value != libraryAddress + codeData.toUInt() * sizeof(quint32)) {
+                        return false;
+                    }
+                } else if (iatSize > 0 && (value < iatAddress || value - iatAddress >= iatSize)) {
+                    // Must still point at one of the original import slots.
+                    return false;
+                }
+            }
+            break;
+
+        case CodeEntry::INJECT_DATA:
+            {
+                QByteArray bytes = bytesAt(codeEntry.getAddress(), codeData.length());
+                QByteArray originalData = codeEntry.getOriginalData();
+
+                if (bytes.isEmpty()) {
+                    return false;
+                }
+
+                if (patched ? bytes != codeData : (originalData.isEmpty() ? bytes == codeData : bytes != originalData)) {
+                    return false;
+                }
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    if (!textData.isEmpty()) {
+        const PeHeader::Section *section = header.findSection(patch_library_pe_text_section);
+
+        if (!patched) {
+            return !section;
+        }
+
+        if (!section || section->sizeOfRawData < static_cast<quint32>(textData.length()) || static_cast<qint64>(section->pointerToRawData) + textData.length() > header.getFileSize()) {
+            return false;
+        }
+
+        return QByteArray::fromRawData(reinterpret_cast<const char*>(data + section->pointerToRawData), textData.length()) == textData;
+    }
+
+    return true;
+}
+
+bool FileUtils::resolveSites(const PeHeader &header, const uchar *data, QList<CodeEntry> &codeEntries)
+{
+    for (CodeEntry &codeEntry : codeEntries) {
+        if (codeEntry.getSignature().isEmpty()) {
+            continue;
+        }
+
+        const PeHeader::Section *section = header.findSection(codeEntry.getSection());
+
+        if (!section || section->pointerToRawData >= header.getFileSize()) {
+            return false;
+        }
+
+        qint64 size = qMin<qint64>(section->sizeOfRawData, header.getFileSize() - section->pointerToRawData);
+        qint64 offset = SignatureScanner(codeEntry.getSignature()).findUnique(reinterpret_cast<const char*>(data + section->pointerToRawData), size);
+
+        if (offset < 0) {
+            return false;
+        }
+
+        codeEntry.setAddress(header.getImageBase() + section->virtualAddress + static_cast<quint32>(offset) + codeEntry.getSignatureOffset());
+    }
+
+    return true;
+}
+
+quint32 FileUtils::getImportAddressTable(const PeHeader &header, const uchar *data, const QString &libraryFile)
+{
+    // Size of one IMAGE_IMPORT_DESCRIPTOR.
+    constexpr quint32 descriptorSize = 20;
+    quint32 directoryRva = header.getDirectoryRva(PeHeader::DIRECTORY_IMPORT);
+
+    if (directoryRva == 0) {
+        return 0;
+    }
+
+    // The descriptor table is terminated by an all zero entry.
+    for (quint32 rva = directoryRva; ; rva += descriptorSize) {
+        qint64 offset = header.rvaToFileOffset(rva, descriptorSize);
 
-    return strcmp(fileCheckSum, targetCheckSum) == 0;
+        if (offset < 0) {
+            return 0;
+        }
+
+        const uchar *descriptor = data + offset;
+        quint32 nameRva = qFromLittleEndian<quint32>(descriptor + 12);
+        quint32 firstThunk = qFromLittleEndian<quint32>(descriptor + 16);
+
+        if (nameRva == 0 && firstThunk == 0) {
+            return 0;
+        }
+
+        qint64 nameOffset = header.rvaToFileOffset(nameRva, 1);
+
+        if (nameOffset < 0) {
+            continue;
+        }
+
+        const char *name = reinterpret_cast<const char*>(data + nameOffset);
+        QString libraryName = QString::fromLatin1(name, qstrnlen(name, static_cast<uint>(qMin<qint64>(header.getFileSize() - nameOffset, 256))));
+
+        if (libraryName.compare(libraryFile, Qt::CaseInsensitive) == 0) {
+            return header.getImageBase() + firstThunk;
+        }
+    }
+}
+
+const std::unordered_map<CheckSum, TargetMatch, CheckSumHash> &FileUtils::getCheckSumIndex(const FileEntry &fileEntry)
+{
+    // Built once from the patch tables, maps every known checksum of a file to its target.
+    static const QHash<QString, std::unordered_map<CheckSum, TargetMatch, CheckSumHash>> index = [] {
+        QHash<QString, std::unordered_map<CheckSum, TargetMatch, CheckSumHash>> index;
+
+        for (const FileEntry &file : PatchDatabase::getFiles()) {
+            std::unordered_map<CheckSum, TargetMatch, CheckSumHash> &checkSums = index[file.getName()];
+            const QList<TargetEntry> &targets = file.getTargets();
+
+            for (int i = 0; i < targets.length(); i++) {
+                checkSums.insert({ targets[i].getCheckSum(), { i, false } });
+
+                // Some targets share the same patched result, first one wins.
+                checkSums.insert({ targets[i].getCheckSumPatched(), { i, true } });
+            }
+        }
+
+        return index;
+    }();
+    static const std::unordered_map<CheckSum, TargetMatch, CheckSumHash> empty;
+
+    QHash<QString, std::unordered_map<CheckSum, TargetMatch, CheckSumHash>>::const_iterator iterator = index.constFind(fileEntry.getName());
+
+    return iterator != index.constEnd() ? iterator.value() : empty;
 }
 
 QString FileUtils::appendToName(const QDir &dir, const FileEntry &fileEntry, const QString &append)
@@ -34,40 +432,137 @@ QString FileUtils::appendToName(const QDir &dir, const FileEntry &fileEntry, con
     return dir.filePath(split.join(QString()) + append + suffix);
 }
 
-bool FileUtils::copy(const QDir &dir, const FileEntry &fileEntry, bool backup)
+bool FileUtils::replace(const QDir &dir, const FileEntry &fileEntry, const QString &temporaryFileName)
 {
     QString fileName = dir.filePath(fileEntry.getName());
-    QString fileCopyName = appendToName(dir, fileEntry, game_backup_suffix);
+    QString backupFileName = appendToName(dir, fileEntry, game_backup_suffix);
     QFile file = fileName;
-    QFile fileCopy = fileCopyName;
 
-    if (backup) {
-        if (!fileCopy.exists()) {
-            return file.rename(fileCopyName) & file.copy(fileName);
-        }
-    } else {
-        if (fileCopy.exists()) {
-            return file.remove() & fileCopy.rename(fileName);
-        }
+    // The original itself becomes the backup, so it never has to be copied.
+    if (file.exists() && !(QFile::exists(backupFileName) ? file.remove() : file.rename(backupFileName))) {
+        return false;
     }
 
-    return false;
+    if (!QFile::rename(temporaryFileName, fileName)) {
+        return false;
+    }
+
+    syncDirectory(dir);
+
+    qDebug().noquote() << QT_TR_NOOP(QString("Replaced file %1, original kept as: %2").arg(fileEntry.getName()).arg(backupFileName));
+
+    return true;
 }
 
-bool FileUtils::backup(const QDir &dir, const FileEntry &fileEntry)
+bool FileUtils::sync(const QString &fileName)
 {
-    bool result = copy(dir, fileEntry, true);
+    QFile file(fileName);
 
-    if (result) {
-        qDebug().noquote() << QT_TR_NOOP(QString("Backing up file: %1").arg(fileEntry.getName()));
+    if (!file.open(QFile::ReadWrite)) {
+        return false;
+    }
+
+#ifdef Q_OS_WIN
+    return FlushFileBuffers(reinterpret_cast<HANDLE>(_get_osfhandle(file.handle())));
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
+
+bool FileUtils::syncDirectory(const QDir &dir)
+{
+#ifdef Q_OS_WIN
+    // NTFS journals renames itself, and directories cannot be flushed through a regular handle.
+    Q_UNUSED(dir)
+
+    return true;
+#else
+    // Renames are only durable once the directory entry itself is on disk.
+    int descriptor = ::open(QFile::encodeName(dir.absolutePath()).constData(), O_RDONLY);
+
+    if (descriptor < 0) {
+        return false;
+    }
+
+    bool result = fsync(descriptor) == 0;
+    ::close(descriptor);
+
+    return result;
+#endif
+}
+
+bool FileUtils::clone(const QString &fileName, const QString &cloneFileName)
+{
+#ifdef Q_OS_LINUX
+    struct stat fileStat;
+    int source = ::open(QFile::encodeName(fileName).constData(), O_RDONLY | O_CLOEXEC);
+
+    if (source < 0) {
+        return false;
+    }
+
+    if (fstat(source, &fileStat) != 0) {
+        ::close(source);
+
+        return false;
+    }
+
+    int destination = ::open(QFile::encodeName(cloneFileName).constData(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, fileStat.st_mode & 0777);
+
+    if (destination < 0) {
+        ::close(source);
+
+        return false;
+    }
+
+    bool result = false;
+
+#ifdef FICLONE
+    // Copy-on-write clone on btrfs and XFS, takes no time or space regardless of the file size.
+    result = ioctl(destination, FICLONE, source) == 0;
+#endif
+
+    // Otherwise let the kernel copy, which still shares extents on filesystems that can.
+    if (!result) {
+        off_t remaining = fileStat.st_size;
+        result = true;
+
+        while (remaining > 0) {
+            ssize_t copied = copy_file_range(source, nullptr, destination, nullptr, remaining, 0);
+
+            if (copied <= 0) {
+                result = false;
+
+                break;
+            }
+
+            remaining -= copied;
+        }
+    }
+
+    ::close(destination);
+    ::close(source);
+
+    if (!result) {
+        ::unlink(QFile::encodeName(cloneFileName).constData());
     }
 
     return result;
+#else
+    Q_UNUSED(fileName)
+    Q_UNUSED(cloneFileName)
+
+    return false;
+#endif
 }
 
 bool FileUtils::restore(const QDir &dir, const FileEntry &fileEntry)
 {
-    bool result = copy(dir, fileEntry, false);
+    QFile file = dir.filePath(fileEntry.getName());
+    QFile fileCopy = appendToName(dir, fileEntry, game_backup_suffix);
+
+    // The backup is the original file itself, moved aside by replace().
+    bool result = fileCopy.exists() && (file.remove() & fileCopy.rename(file.fileName()));
 
     if (result) {
         qDebug().noquote() << QT_TR_NOOP(QString("Restoring file: %1").arg(fileEntry.getName()));
@@ -75,3 +570,88 @@ bool FileUtils::restore(const QDir &dir, const FileEntry &fileEntry)
 
     return result;
 }
+
+QString FileUtils::getFileId(const QFileInfo &fileInfo)
+{
+#ifdef Q_OS_WIN
+    HANDLE handle = CreateFileW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(fileInfo.absoluteFilePath()).utf16()), 0, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS, nullptr);
+
+    if (handle == INVALID_HANDLE_VALUE) {
+        return QString();
+    }
+
+    BY_HANDLE_FILE_INFORMATION information;
+    bool result = GetFileInformationByHandle(handle, &information);
+    CloseHandle(handle);
+
+    if (!result) {
+        return QString();
+    }
+
+    quint64 index = (static_cast<quint64>(information.nFileIndexHigh) << 32) | information.nFileIndexLow;
+
+    return QString("%1:%2").arg(information.dwVolumeSerialNumber).arg(index);
+#else
+    struct stat fileStat;
+
+    if (stat(QFile::encodeName(fileInfo.absoluteFilePath()).constData(), &fileStat) != 0) {
+        return QString();
+    }
+
+    return QString("%1:%2").arg(static_cast<quint64>(fileStat.st_dev)).arg(static_cast<quint64>(fileStat.st_ino));
+#endif
+}
+
+QString FileUtils::getCacheKey(const QFileInfo &fileInfo)
+{
+    // Paths contain characters that are not allowed in settings keys, so use a hash of it instead.
+    return QCryptographicHash::hash(fileInfo.canonicalFilePath().toUtf8(), QCryptographicHash::Sha1).toHex();
+}
+
+bool FileUtils::readCheckSumCache(const QFileInfo &fileInfo, CheckSum &checkSum)
+{
+    if (!checkSumCacheEnabled || !fileInfo.exists()) {
+        return false;
+    }
+
+    QMutexLocker locker(&checkSumCacheMutex);
+    QSettings cache(app_checksum_cache_file, QSettings::IniFormat);
+    bool result = false;
+
+    cache.beginGroup(getCacheKey(fileInfo));
+        // Only trust the cached checksum if nothing about the file has changed since it was hashed.
+        if (cache.value(checksum_cache_path).toString() == fileInfo.canonicalFilePath() &&
+            cache.value(checksum_cache_size).toLongLong() == fileInfo.size() &&
+            cache.value(checksum_cache_modified).toLongLong() == fileInfo.lastModified().toMSecsSinceEpoch() &&
+            cache.value(checksum_cache_file_id).toString() == getFileId(fileInfo)) {
+            checkSum = toCheckSum(QByteArray::fromHex(cache.value(checksum_cache_checksum).toByteArray()));
+            result = checkSum != CheckSum();
+        }
+    cache.endGroup();
+
+    return result;
+}
+
+void FileUtils::writeCheckSumCache(const QFileInfo &fileInfo, const CheckSum &checkSum)
+{
+    if (!checkSumCacheEnabled) {
+        return;
+    }
+
+    QString fileId = getFileId(fileInfo);
+
+    // Without a file id we cannot tell a replaced file apart, so don't cache it.
+    if (fileId.isEmpty()) {
+        return;
+    }
+
+    QMutexLocker locker(&checkSumCacheMutex);
+    QSettings cache(app_checksum_cache_file, QSettings::IniFormat);
+    cache.beginGroup(getCacheKey(fileInfo));
+        cache.setValue(checksum_cache_path, fileInfo.canonicalFilePath());
+        cache.setValue(checksum_cache_size, fileInfo.size());
+        cache.setValue(checksum_cache_modified, fileInfo.lastModified().toMSecsSinceEpoch());
+        cache.setValue(checksum_cache_file_id, fileId);
+        cache.setValue(checksum_cache_checksum, toHex(checkSum));
+    cache.endGroup();
+}
@@ -4,20 +4,70 @@
 #include <QDir>
 #include <QString>
 #include <QFile>
+#include <QFileInfo>
+#include <QByteArray>
+#include <QHash>
+#include <QFuture>
+#include <QMutex>
+
+#include <unordered_map>
 
 #include "entry.h"
+#include "peheader.h"
+#include "patchprogress.h"
+
+struct TargetMatch {
+    int index = -1; // Index into FileEntry::getTargets(), -1 when no target matched.
+    bool patched = false;
+
+    bool isValid() const {
+        return index >= 0;
+    }
+};
+
+enum class VerificationMode {
+    CheckSum,  // SHA-256 of the whole file against the stored checksums.
+    PatchSites // Only the bytes at every patched address.
+};
 
 class FileUtils
 {
 public:
-    static const char *checkSum(QFile file);
+    static void setVerificationMode(VerificationMode mode);
+    static VerificationMode getVerificationMode();
+    static void setCheckSumCacheEnabled(bool enabled);
+
+    static CheckSum checkSum(QFile file, PatchProgress *progress = nullptr);
+    static QFuture<CheckSum> checkSumAsync(const QString &fileName);
+    static void cacheCheckSum(const QString &fileName, const CheckSum &checkSum);
+    static CheckSum toCheckSum(const QByteArray &digest);
+    static QByteArray toHex(const CheckSum &checkSum);
+    static TargetMatch identify(const QDir &dir, const FileEntry &fileEntry, PatchProgress *progress = nullptr);
+    static QFuture<TargetMatch> identifyAsync(const QDir &dir, const FileEntry &fileEntry);
     static bool isValid(const QDir &dir, const FileEntry &fileEntry, const TargetEntry &target, bool patched);
+    static bool isValid(const QString &fileName, const TargetEntry &target, bool patched);
     static QString appendToName(const QDir &dir, const FileEntry &fileEntry, const QString &append);
-    static bool backup(const QDir &dir, const FileEntry &fileEntry);
+    static bool clone(const QString &fileName, const QString &cloneFileName);
     static bool restore(const QDir &dir, const FileEntry &fileEntry);
+    static bool replace(const QDir &dir, const FileEntry &fileEntry, const QString &temporaryFileName);
+    static bool sync(const QString &fileName);
+    static bool syncDirectory(const QDir &dir);
 
 private:
-    static bool copy(const QDir &dir, const FileEntry &fileEntry, bool backup);
+    static VerificationMode verificationMode;
+    static bool checkSumCacheEnabled;
+    static QMutex checkSumCacheMutex;
+
+    static QList<TargetMatch> identifyBySites(const QString &fileName, const FileEntry &fileEntry);
+    static bool isValidBySites(const QString &fileName, const TargetEntry &target, bool patched);
+    static bool verifySites(const PeHeader &header, const uchar *data, const TargetEntry &target, bool patched);
+    static bool resolveSites(const PeHeader &header, const uchar *data, QList<CodeEntry> &codeEntries);
+    static quint32 getImportAddressTable(const PeHeader &header, const uchar *data, const QString &libraryFile);
+    static const std::unordered_map<CheckSum, TargetMatch, CheckSumHash> &getCheckSumIndex(const FileEntry &fileEntry);
+    static QString getFileId(const QFileInfo &fileInfo);
+    static QString getCacheKey(const QFileInfo &fileInfo);
+    static bool readCheckSumCache(const QFileInfo &fileInfo, CheckSum &checkSum);
+    static void writeCheckSumCache(const QFileInfo &fileInfo, const CheckSum &checkSum);
 };
 
 #endif // FILEUTILS_H
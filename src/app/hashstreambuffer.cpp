@@ -0,0 +1,79 @@
+#include <limits>
+
+#include "hashstreambuffer.h"
+
+// Report written bytes in steps of this size, the PE is written in many small pieces.
+constexpr std::streamsize hashstreambuffer_progress_step = 1024 * 1024;
+
+HashStreamBuffer::HashStreamBuffer(std::streambuf *target, QCryptographicHash::Algorithm algorithm, PatchProgress *progress) :
+    target(target),
+    hash(algorithm),
+    progress(progress)
+{
+
+}
+
+QByteArray HashStreamBuffer::result() const
+{
+    return hash.result();
+}
+
+HashStreamBuffer::int_type HashStreamBuffer::overflow(int_type character)
+{
+    if (traits_type::eq_int_type(character, traits_type::eof())) {
+        return traits_type::not_eof(character);
+    }
+
+    char data = traits_type::to_char_type(character);
+
+    return xsputn(&data, 1) == 1 ? character : traits_type::eof();
+}
+
+std::streamsize HashStreamBuffer::xsputn(const char *data, std::streamsize count)
+{
+    std::streamsize written = target->sputn(data, count);
+
+    // Only hash what actually made it out, so the digest always matches the written file.
+    for (std::streamsize offset = 0; offset < written; offset += std::numeric_limits<int>::max()) {
+        hash.addData(data + offset, static_cast<int>(qMin<std::streamsize>(written - offset, std::numeric_limits<int>::max())));
+    }
+
+    position += written;
+    reportProgress(hashstreambuffer_progress_step);
+
+    return written;
+}
+
+HashStreamBuffer::pos_type HashStreamBuffer::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+{
+    // Output is hashed in order, so only reporting the current position is supported.
+    if (offset == 0 && direction == std::ios_base::cur && (mode & std::ios_base::out)) {
+        return pos_type(position);
+    }
+
+    return pos_type(off_type(-1));
+}
+
+HashStreamBuffer::pos_type HashStreamBuffer::seekpos(pos_type newPosition, std::ios_base::openmode mode)
+{
+    if (off_type(newPosition) == position && (mode & std::ios_base::out)) {
+        return newPosition;
+    }
+
+    return pos_type(off_type(-1));
+}
+
+int HashStreamBuffer::sync()
+{
+    reportProgress(1);
+
+    return target->pubsync();
+}
+
+void HashStreamBuffer::reportProgress(std::streamsize minimum)
+{
+    if (progress && position - reported >= minimum) {
+        progress->addBytesWritten(position - reported);
+        reported = position;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef HASHSTREAMBUFFER_H
+#define HASHSTREAMBUFFER_H
+
+#include <streambuf>
+
+#include <QCryptographicHash>
+
+#include "patchprogress.h"
+
+// Output stream buffer which forwards everything to another buffer while hashing it on the way out.
+class HashStreamBuffer : public std::streambuf
+{
+public:
+    HashStreamBuffer(std::streambuf *target, QCryptographicHash::Algorithm algorithm = QCryptographicHash::Sha256, PatchProgress *progress = nullptr);
+
+    QByteArray result() const;
+
+protected:
+    int_type overflow(int_type character) override;
+    std::streamsize xsputn(const char *data, std::streamsize count) override;
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode) override;
+    pos_type seekpos(pos_type newPosition, std::ios_base::openmode mode) override;
+    int sync() override;
+
+private:
+    std::streambuf *target;
+    QCryptographicHash hash;
+    std::streamsize position = 0;
+    PatchProgress *progress;
+    std::streamsize reported = 0; // Part of position already reported as written.
+
+    void reportProgress(std::streamsize minimum);
+};
+
+#endif // HASHSTREAMBUFFER_H
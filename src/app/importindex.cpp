@@ -0,0 +1,35 @@
+#include "importindex.h"
+
+void ImportIndex::clear()
+{
+    functions.clear();
+    ordinals.clear();
+}
+
+void ImportIndex::insert(const QString &library, const QString &function, quint16 ordinal, quint32 address)
+{
+    // Imports have either a name or an ordinal, the first slot wins if an image imports the same function twice.
+    if (!function.isEmpty()) {
+        QPair<QString, QString> key(library.toLower(), function);
+
+        if (!functions.contains(key)) {
+            functions.insert(key, address);
+        }
+    } else {
+        QPair<QString, quint16> key(library.toLower(), ordinal);
+
+        if (!ordinals.contains(key)) {
+            ordinals.insert(key, address);
+        }
+    }
+}
+
+quint32 ImportIndex::find(const QString &library, const QString &function) const
+{
+    return functions.value({ library.toLower(), function });
+}
+
+quint32 ImportIndex::find(const QString &library, quint16 ordinal) const
+{
+    return ordinals.value({ library.toLower(), ordinal });
+}
@@ -0,0 +1,22 @@
+#ifndef IMPORTINDEX_H
+#define IMPORTINDEX_H
+
+#include <QHash>
+#include <QPair>
+#include <QString>
+
+// Import slots of an image by library and function name or ordinal, library names compare case-insensitively like the loader does.
+class ImportIndex
+{
+public:
+    void clear();
+    void insert(const QString &library, const QString &function, quint16 ordinal, quint32 address);
+    quint32 find(const QString &library, const QString &function) const;
+    quint32 find(const QString &library, quint16 ordinal) const;
+
+private:
+    QHash<QPair<QString, QString>, quint32> functions;
+    QHash<QPair<QString, quint16>, quint32> ordinals;
+};
+
+#endif // IMPORTINDEX_H
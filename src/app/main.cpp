@@ -1,13 +1,28 @@
 #include <QApplication>
 
 #include "widget.h"
+#include "commandline.h"
 
-int main(int argc, char *argv[])
+template<typename Application>
+static void setApplicationInfo(Application &app)
 {
-    QApplication app(argc, argv);
     app.setOrganizationName(app_name);
     app.setApplicationName(app_organization);
     app.setApplicationVersion(APP_VERSION);
+}
+
+int main(int argc, char *argv[])
+{
+    // Patch without any GUI when asked to from the command line.
+    if (CommandLine::isRequested(argc, argv)) {
+        QCoreApplication app(argc, argv);
+        setApplicationInfo(app);
+
+        return CommandLine::exec(app);
+    }
+
+    QApplication app(argc, argv);
+    setApplicationInfo(app);
 
     // Display the GUI widget.
     Widget widget;
@@ -0,0 +1,45 @@
+#include "memorystreambuffer.h"
+
+MemoryStreamBuffer::MemoryStreamBuffer(const char *data, std::streamsize size)
+{
+    // The get area is never written to, std::streambuf just lacks a const interface.
+    char *begin = const_cast<char*>(data);
+    setg(begin, begin, begin + size);
+}
+
+MemoryStreamBuffer::pos_type MemoryStreamBuffer::seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode)
+{
+    if (!(mode & std::ios_base::in)) {
+        return pos_type(off_type(-1));
+    }
+
+    off_type base = 0;
+
+    switch (direction) {
+    case std::ios_base::cur:
+        base = gptr() - eback();
+        break;
+
+    case std::ios_base::end:
+        base = egptr() - eback();
+        break;
+
+    default:
+        break;
+    }
+
+    return seekpos(pos_type(base + offset), mode);
+}
+
+MemoryStreamBuffer::pos_type MemoryStreamBuffer::seekpos(pos_type newPosition, std::ios_base::openmode mode)
+{
+    off_type position = off_type(newPosition);
+
+    if (!(mode & std::ios_base::in) || position < 0 || position > egptr() - eback()) {
+        return pos_type(off_type(-1));
+    }
+
+    setg(eback(), eback() + position, egptr());
+
+    return newPosition;
+}
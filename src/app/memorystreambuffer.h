@@ -0,0 +1,17 @@
+#ifndef MEMORYSTREAMBUFFER_H
+#define MEMORYSTREAMBUFFER_H
+
+#include <streambuf>
+
+// Read-only input stream buffer over memory owned by someone else, typically a mapped file.
+class MemoryStreamBuffer : public std::streambuf
+{
+public:
+    MemoryStreamBuffer(const char *data, std::streamsize size);
+
+protected:
+    pos_type seekoff(off_type offset, std::ios_base::seekdir direction, std::ios_base::openmode mode) override;
+    pos_type seekpos(pos_type newPosition, std::ios_base::openmode mode) override;
+};
+
+#endif // MEMORYSTREAMBUFFER_H
@@ -0,0 +1,67 @@
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QUuid>
+#include <QDebug>
+
+#include "outputcache.h"
+#include "fileutils.h"
+#include "global.h"
+#include "patchdatabase.h"
+
+bool OutputCache::materialize(const CheckSum &checkSum, const QString &outputFileName)
+{
+    QString cacheFileName = getFileName(checkSum);
+
+    if (!QFile::exists(cacheFileName)) {
+        return false;
+    }
+
+    QFile::remove(outputFileName);
+
+    // A clone costs nothing on filesystems that support it.
+    if (!FileUtils::clone(cacheFileName, outputFileName) && !QFile::copy(cacheFileName, outputFileName)) {
+        return false;
+    }
+
+    qDebug().noquote() << QT_TR_NOOP(QString("Using cached patched file: %1").arg(cacheFileName));
+
+    return true;
+}
+
+bool OutputCache::store(const QString &fileName, const CheckSum &checkSum)
+{
+    QString cacheFileName = getFileName(checkSum);
+
+    // Other installs may be storing the same output right now, so every writer gets a name of its own.
+    QString temporaryFileName = cacheFileName + game_temporary_suffix + QUuid::createUuid().toString(QUuid::WithoutBraces);
+
+    if (QFile::exists(cacheFileName)) {
+        return true;
+    }
+
+    if (!QDir().mkpath(QFileInfo(cacheFileName).absolutePath())) {
+        return false;
+    }
+
+    if (!FileUtils::clone(fileName, temporaryFileName) && !QFile::copy(fileName, temporaryFileName)) {
+        QFile::remove(temporaryFileName);
+
+        return false;
+    }
+
+    // Only complete files ever show up under the final name, whichever writer gets there first wins.
+    if (!QFile::rename(temporaryFileName, cacheFileName)) {
+        QFile::remove(temporaryFileName);
+
+        return QFile::exists(cacheFileName);
+    }
+
+    return true;
+}
+
+QString OutputCache::getFileName(const CheckSum &checkSum)
+{
+    // Outputs depend on the tables they were patched with, which an external patch database can change without a new build.
+    return QDir(app_output_cache_directory).filePath(QString("%1/%2/%3").arg(patch_table_version).arg(PatchDatabase::getId()).arg(QString(FileUtils::toHex(checkSum))));
+}
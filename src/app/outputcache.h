@@ -0,0 +1,18 @@
+#ifndef OUTPUTCACHE_H
+#define OUTPUTCACHE_H
+
+#include <QString>
+
+#include "checksum.h"
+
+// Patched outputs keyed by the digest of their input, shared by every install patched from this directory.
+// Only used when verifying by checksum, that is the only mode in which both the input and every hit are known byte for byte.
+class OutputCache
+{
+public:
+    static bool materialize(const CheckSum &checkSum, const QString &outputFileName);
+    static bool store(const QString &fileName, const CheckSum &checkSum);
+    static QString getFileName(const CheckSum &checkSum);
+};
+
+#endif // OUTPUTCACHE_H
@@ -1,11 +1,20 @@
 #include <QFile>
-#include <QMessageBox>
 #include <QSettings>
+#include <QFuture>
+#include <QElapsedTimer>
+#include <QtConcurrent>
+#include <QMutexLocker>
 
 #include "patcher.h"
 #include "global.h"
+#include "patchdatabase.h"
 #include "fileutils.h"
+#include "delta.h"
 #include "pefile.h"
+#include "patchplan.h"
+#include "outputcache.h"
+
+QMutex Patcher::journalMutex;
 
 bool Patcher::isPatched(QString path)
 {
@@ -14,27 +23,33 @@ bool Patcher::isPatched(QString path)
     }
 
     QDir dir = path;
+    const QList<FileEntry> &files = PatchDatabase::getFiles();
     int count = 0;
 
     // Should we be looking in executable directory instead?
     if (dir.exists() | dir.cd(game_executable_directory)) {
+        QList<QFuture<TargetMatch>> matches;
+
+        // Hash all files concurrently.
         for (const FileEntry &file : files) {
-            for (const TargetEntry &target : file.getTargets()) {
-                // Check if target file is patched.
-                if (FileUtils::isValid(dir, file, target, true)) {
-                    count++;
+            matches.append(FileUtils::identifyAsync(dir, file));
+        }
 
-                    break;
-                }
+        for (int i = 0; i < files.length(); i++) {
+            const FileEntry &file = files[i];
 
-                QFile backupFile = FileUtils::appendToName(dir, file, game_backup_suffix);
+            // Check if target file is patched.
+            if (matches[i].result().patched) {
+                count++;
 
-                // Detect old installations of the patch.
-                if (backupFile.exists()) {
-                    count++;
+                continue;
+            }
 
-                    break;
-                }
+            QFile backupFile = FileUtils::appendToName(dir, file, game_backup_suffix);
+
+            // Detect old installations of the patch.
+            if (backupFile.exists()) {
+                count++;
             }
         }
     }
@@ -64,79 +79,340 @@ bool Patcher::copyFiles(const QDir &dir)
     return success;
 }
 
-bool Patcher::patchFile(const QDir &dir, const FileEntry &fileEntry, const TargetEntry &target)
+bool Patcher::writeFile(const QDir &dir, const FileEntry &fileEntry, const TargetEntry &target, const QString &outputFileName, FileReport &fileReport, CheckSum &checkSum, PatchProgress *progress)
 {
     QFile file = dir.filePath(fileEntry.getName());
+    QElapsedTimer timer;
+
+    // Only checking patch sites does not need a byte exact rebuild, so just append to the original file then.
+    bool verifySites = FileUtils::getVerificationMode() == VerificationMode::PatchSites;
+
+    // Identical installs share one patched output, only the first install of each edition has to build it.
+    // Identifying by checksum already proved the input is exactly the target, and the hit is hashed again before it is trusted.
+    if (!verifySites) {
+        timer.start();
+        bool cached = OutputCache::materialize(target.getCheckSum(), outputFileName) && FileUtils::isValid(outputFileName, target, true);
+        fileReport.timings.append({ "cache", timer.nsecsElapsed() });
+
+        if (cached) {
+            checkSum = target.getCheckSumPatched();
+
+            // Shared from the cache in one go, nothing is streamed.
+            if (progress) {
+                progress->addBytesWritten(QFileInfo(outputFileName).size());
+            }
+
+            return true;
+        }
+
+        QFile::remove(outputFileName);
+    }
+
+    // A delta for this edition goes straight to the known patched bytes, without touching the PE at all.
+    QString deltaFileName = Delta::getFileName(target.getCheckSum());
+
+    if (QFile::exists(deltaFileName)) {
+        timer.start();
+        bool applied = Delta::apply(deltaFileName, file.fileName(), target.getCheckSumPatched(), outputFileName, progress);
+        fileReport.timings.append({ "delta", timer.nsecsElapsed() });
+
+        if (applied) {
+            checkSum = target.getCheckSumPatched();
+
+            if (!verifySites) {
+                OutputCache::store(outputFileName, target.getCheckSum());
+            }
+
+            return true;
+        }
+    }
+
+    QString planFileName = PatchPlan::getCacheFileName(target.getCheckSum());
+    bool written = false;
+
+    // A plan compiled for this target earlier skips parsing the PE altogether.
+    if (verifySites) {
+        timer.start();
+        written = PatchPlan::load(planFileName).apply(file.fileName(), outputFileName, progress);
+
+        if (written) {
+            fileReport.timings.append({ "plan", timer.nsecsElapsed() });
+        }
+    }
+
+    if (!written) {
+        // Create PeFile instance for this particular target.
+        timer.start();
+        PeFile *peFile = new PeFile(file);
+        fileReport.timings.append({ "read", timer.nsecsElapsed() });
+
+        // Apply PE and binary patches.
+        timer.start();
+        bool applied = peFile->apply(patch_library_pe_import_section, patch_library_file, patch_library_functions, target.getCodeEntries());
+        fileReport.timings.append({ "apply", timer.nsecsElapsed() });
+
+        // Never write out a half patched image.
+        if (!applied) {
+            delete peFile;
+
+            return false;
+        }
+
+        timer.start();
+
+        if (verifySites) {
+            PatchPlan plan = peFile->compilePlan();
+            written = plan.apply(file.fileName(), outputFileName, progress);
+
+            if (written) {
+                plan.save(planFileName);
+            }
+        }
+
+        // Write PE to file, the checksum is calculated while writing.
+        if (!written) {
+            written = peFile->write(verifySites ? nullptr : &checkSum, PeFile::WRITE_REBUILD, outputFileName, progress);
+        }
+
+        fileReport.timings.append({ "write", timer.nsecsElapsed() });
+
+        delete peFile;
+    }
+
+    if (!written) {
+        return false;
+    }
+
+    timer.start();
+    bool valid = verifySites ? FileUtils::isValid(outputFileName, target, true) : checkSum == target.getCheckSumPatched();
+    fileReport.timings.append({ "verify", timer.nsecsElapsed() });
+
+    if (DEBUG_MODE && !verifySites)
+        qDebug().noquote() << QT_TR_NOOP(QString("New checksum for file %1 is \"%2\"").arg(fileEntry.getName()).arg(QString(FileUtils::toHex(checkSum))));
+
+    if (valid && !verifySites) {
+        OutputCache::store(outputFileName, target.getCheckSum());
+    }
+
+    // When debugging the rebuilt file is put in place even if it does not verify, so it can be inspected.
+    return valid || DEBUG_MODE;
+}
+
+bool Patcher::patchFile(const QDir &dir, const FileEntry &fileEntry, const TargetEntry &target, FileReport &fileReport, PatchProgress *progress)
+{
+    QFile file = dir.filePath(fileEntry.getName());
+    QString temporaryFileName = FileUtils::appendToName(dir, fileEntry, game_temporary_suffix);
+    CheckSum checkSum {};
+    QElapsedTimer timer;
 
     qDebug().noquote() << QT_TR_NOOP(QString("Patching file %1").arg(file.fileName()));
 
-    // Create PeFile instance for this particular target.
-    PeFile *peFile = new PeFile(file);
+    // The patched file is written next to the original, which stays untouched until the new one is complete, verified and on disk.
+    writeJournal(dir, fileEntry, patch_journal_state_writing);
+    QFile::remove(temporaryFileName);
+
+    // Canceling is honored right up to the commit, until then only the temporary file has to go.
+    bool valid = (!progress || !progress->isCanceled()) && writeFile(dir, fileEntry, target, temporaryFileName, fileReport, checkSum, progress);
+
+    timer.start();
+    valid = valid && FileUtils::sync(temporaryFileName);
+    fileReport.timings.append({ "sync", timer.nsecsElapsed() });
+    valid = valid && (!progress || !progress->isCanceled());
+
+    if (!valid) {
+        QFile::remove(temporaryFileName);
+        clearJournal(dir, fileEntry);
+
+        return false;
+    }
+
+    // From here on an interrupted run is finished on the next start rather than rolled back.
+    writeJournal(dir, fileEntry, patch_journal_state_committing);
+
+    timer.start();
+    bool replaced = FileUtils::replace(dir, fileEntry, temporaryFileName);
+    fileReport.timings.append({ "commit", timer.nsecsElapsed() });
+
+    if (!replaced) {
+        return false;
+    }
 
-    // Apply PE and binary patches.
-    peFile->apply(patch_library_pe_import_section, patch_library_file, patch_library_functions, target.getCodeEntries());
+    clearJournal(dir, fileEntry);
 
-    // Write PE to file.
-    peFile->write();
+    // Remember the checksum so the patched file is never read back just to hash it.
+    if (checkSum != CheckSum {}) {
+        FileUtils::cacheCheckSum(file.fileName(), checkSum);
+    }
 
-    delete peFile;
+    return true;
+}
 
-    if (DEBUG_MODE)
-        qDebug().noquote() << QT_TR_NOOP(QString("New checksum for file %1 is \"%2\"").arg(fileEntry.getName()).arg(FileUtils::checkSum(dir.filePath(fileEntry.getName()))));
+void Patcher::writeJournal(const QDir &dir, const FileEntry &fileEntry, const QString &state)
+{
+    QMutexLocker locker(&journalMutex);
+    QSettings journal(dir.filePath(patch_journal_file), QSettings::IniFormat);
+    journal.setValue(fileEntry.getName(), state);
+    journal.sync();
+}
 
-    return FileUtils::isValid(dir, fileEntry, target, true);
+void Patcher::clearJournal(const QDir &dir, const FileEntry &fileEntry)
+{
+    QMutexLocker locker(&journalMutex);
+    bool empty = false;
+
+    {
+        QSettings journal(dir.filePath(patch_journal_file), QSettings::IniFormat);
+        journal.remove(fileEntry.getName());
+        journal.sync();
+        empty = journal.allKeys().isEmpty();
+    }
+
+    if (empty) {
+        QFile::remove(dir.filePath(patch_journal_file));
+    }
 }
 
-bool Patcher::patch(QWidget *parent, const QDir &dir)
+void Patcher::recover(const QDir &dir)
 {
-    unsigned int count = 0;
-
-    // Scanning for valid files to start patching.
-    for (const FileEntry &fileEntry : files) {
-        QFile file = dir.filePath(fileEntry.getName());
-        QFileInfo fileInfo = file;
-
-        // What permissions should be set for files.
-        QFileDevice::Permissions permissions =
-                QFileDevice::WriteOther |
-                QFileDevice::ReadOther |
-                QFileDevice::WriteGroup |
-                QFileDevice::ReadGroup |
-                QFileDevice::WriteUser |
-                QFileDevice::ReadUser |
-                QFileDevice::WriteOwner |
-                QFileDevice::ReadOwner;
-
-        // If file is not writable, set proper permissions.
-        if (!fileInfo.permission(permissions)) {
-            qDebug().noquote() << QT_TR_NOOP(QString("Setting write permissions for protected file %1").arg(fileEntry.getName()));
-
-            file.setPermissions(permissions);
-        }
+    QMutexLocker locker(&journalMutex);
+    QString journalFileName = dir.filePath(patch_journal_file);
+
+    if (!QFile::exists(journalFileName)) {
+        return;
+    }
 
-        for (const TargetEntry &target : fileEntry.getTargets()) {
-            // Validate target file against stored checksum.
-            if (FileUtils::isValid(dir, fileEntry, target, false)) {
-                // Backup original file.
-                FileUtils::backup(dir, fileEntry);
+    {
+        QSettings journal(journalFileName, QSettings::IniFormat);
 
-                // Patch target file.
-                if (!DEBUG_MODE & !patchFile(dir, fileEntry, target)) {
-                    undoPatch(dir);
-                    QMessageBox::warning(parent, "Warning", QT_TR_NOOP(QString("Invalid checksum for patched file %1, aborting!").arg(fileEntry.getName())));
+        for (const FileEntry &fileEntry : PatchDatabase::getFiles()) {
+            QString state = journal.value(fileEntry.getName()).toString();
+            QString temporaryFileName = FileUtils::appendToName(dir, fileEntry, game_temporary_suffix);
 
-                    return false;
-                }
+            if (state == patch_journal_state_committing && QFile::exists(temporaryFileName)) {
+                // The patched file was complete and verified, finish putting it in place.
+                qDebug().noquote() << QT_TR_NOOP(QString("Recovering interrupted patch of file %1").arg(fileEntry.getName()));
 
-                count++;
+                FileUtils::replace(dir, fileEntry, temporaryFileName);
+            } else if (!state.isEmpty()) {
+                // Interrupted while writing, the original was never touched.
+                QFile::remove(temporaryFileName);
             }
         }
     }
 
+    QFile::remove(journalFileName);
+}
+
+FileReport Patcher::patchEntry(const QDir &dir, const FileEntry &fileEntry, PatchProgress *progress)
+{
+    QFile file = dir.filePath(fileEntry.getName());
+    QFileInfo fileInfo = file;
+    FileReport fileReport;
+    fileReport.fileName = fileEntry.getName();
+
+    // What permissions should be set for files.
+    QFileDevice::Permissions permissions =
+            QFileDevice::WriteOther |
+            QFileDevice::ReadOther |
+            QFileDevice::WriteGroup |
+            QFileDevice::ReadGroup |
+            QFileDevice::WriteUser |
+            QFileDevice::ReadUser |
+            QFileDevice::WriteOwner |
+            QFileDevice::ReadOwner;
+
+    // If file is not writable, set proper permissions.
+    if (!fileInfo.permission(permissions)) {
+        qDebug().noquote() << QT_TR_NOOP(QString("Setting write permissions for protected file %1").arg(fileEntry.getName()));
+
+        file.setPermissions(permissions);
+    }
+
+    if (progress) {
+        progress->startFile(fileEntry.getName());
+    }
+
+    // Validate target file against stored checksums.
+    QElapsedTimer timer;
+    timer.start();
+    TargetMatch match = FileUtils::identify(dir, fileEntry, progress);
+    fileReport.timings.append({ "identify", timer.nsecsElapsed() });
+
+    // Nothing has been touched yet, so stopping here needs no cleanup of this file.
+    if (!match.isValid() || (progress && progress->isCanceled())) {
+        return fileReport;
+    }
+
+    const TargetEntry &target = fileEntry.getTargets().at(match.index);
+    fileReport.target = target.getName();
+    fileReport.status = match.patched ? FileReport::ALREADY_PATCHED : FileReport::PATCHED;
+
+    if (!match.patched) {
+        // Patch target file, the original only becomes the backup once the patched file is in place.
+        if (!patchFile(dir, fileEntry, target, fileReport, progress)) {
+            fileReport.status = progress && progress->isCanceled() ? FileReport::CANCELED : FileReport::FAILED;
+        }
+    }
+
+    return fileReport;
+}
+
+bool Patcher::patch(const QDir &dir, PatchReport *report, PatchProgress *progress)
+{
+    PatchReport localReport;
+
+    // Deal with leftovers of an interrupted run before looking at the files.
+    recover(dir);
+
+    if (!report) {
+        report = &localReport;
+    }
+
+    if (progress) {
+        qint64 totalBytes = 0;
+
+        // Every file is read once to identify it and written once when patched.
+        for (const FileEntry &fileEntry : PatchDatabase::getFiles()) {
+            totalBytes += 2 * QFileInfo(dir.filePath(fileEntry.getName())).size();
+        }
+
+        // Not a reset, canceling may already have been requested before this thread got here.
+        progress->setTotalBytes(totalBytes);
+    }
+
+    QList<QFuture<FileReport>> jobs;
+
+    // Files do not depend on each other, so hashing one overlaps with rebuilding another.
+    for (const FileEntry &fileEntry : PatchDatabase::getFiles()) {
+        jobs.append(QtConcurrent::run([dir, fileEntry, progress] {
+            return patchEntry(dir, fileEntry, progress);
+        }));
+    }
+
+    // Wait for every file before rolling back, so nothing is still being written while restoring.
+    for (const QFuture<FileReport> &job : jobs) {
+        const FileReport &fileReport = job.result();
+        report->files.append(fileReport);
+
+        if (fileReport.status == FileReport::FAILED && report->error.isEmpty()) {
+            report->error = QT_TR_NOOP(QString("Invalid checksum for patched file %1, aborting!").arg(fileReport.fileName));
+        }
+    }
+
+    if (progress && progress->isCanceled() && report->error.isEmpty()) {
+        report->error = QT_TR_NOOP(QString("Patching was canceled."));
+    }
+
+    if (!report->error.isEmpty()) {
+        undoPatch(dir);
+
+        return false;
+    }
+
     // Copy needed libraries.
     if (!DEBUG_MODE & !copyFiles(dir)) {
+        report->error = QT_TR_NOOP(QString("Missing patch files, make sure you unzipped the compressed file, aborting!"));
         undoPatch(dir);
-        QMessageBox::warning(parent, "Warning", QT_TR_NOOP(QString("Missing patch files, make sure you unzipped the compressed file, aborting!")));
 
         return false;
     }
@@ -144,15 +420,37 @@ bool Patcher::patch(QWidget *parent, const QDir &dir)
     return true;
 }
 
-void Patcher::undoPatch(const QDir &dir) {
-    // Restore patched files.
-    for (const FileEntry &fileEntry : files) {
-        FileUtils::restore(dir, fileEntry);
+bool Patcher::undoPatch(const QDir &dir, PatchReport *report) {
+    PatchReport localReport;
+
+    if (!report) {
+        report = &localReport;
     }
 
-    // Delete backed up game files.
-    for (const FileEntry &fileEntry : files) {
-        QFile::remove(dir.filePath(FileUtils::appendToName(dir, fileEntry, game_backup_suffix)));
+    // Finish an interrupted patch first, so the backup is where restoring expects it.
+    recover(dir);
+
+    bool result = true;
+
+    // Restore patched files, a backup that could not be restored is kept so the original is not lost.
+    for (const FileEntry &fileEntry : PatchDatabase::getFiles()) {
+        FileReport fileReport;
+        fileReport.fileName = fileEntry.getName();
+
+        if (!QFile::exists(FileUtils::appendToName(dir, fileEntry, game_backup_suffix))) {
+            fileReport.status = FileReport::NOT_PATCHED;
+        } else if (FileUtils::restore(dir, fileEntry)) {
+            fileReport.status = FileReport::RESTORED;
+        } else {
+            fileReport.status = FileReport::FAILED;
+            result = false;
+
+            if (report->error.isEmpty()) {
+                report->error = QT_TR_NOOP(QString("Could not restore original file %1.").arg(fileReport.fileName));
+            }
+        }
+
+        report->files.append(fileReport);
     }
 
     // Delete patch library file.
@@ -165,6 +463,8 @@ void Patcher::undoPatch(const QDir &dir) {
 
     // Remove network configuration file.
     QFile::remove(dir.filePath(patch_configuration_file));
+
+    return result;
 }
 
 void Patcher::generateConfigurationFile(const QDir &dir, const QNetworkInterface &interface)
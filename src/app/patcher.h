@@ -2,23 +2,55 @@
 #define PATCHER_H
 
 #include <QString>
-#include <QWidget>
 #include <QDir>
+#include <QList>
+#include <QPair>
 #include <QNetworkInterface>
+#include <QMutex>
 
 #include "entry.h"
+#include "patchprogress.h"
+
+struct FileReport {
+    enum Status {
+        UNKNOWN,          // Not any known target, left untouched.
+        ALREADY_PATCHED,
+        PATCHED,
+        FAILED,
+        CANCELED,         // Canceled before the original was replaced, left untouched.
+        RESTORED,         // Original put back from its backup.
+        NOT_PATCHED       // No backup to restore, left untouched.
+    };
+
+    QString fileName;
+    QString target; // Name of the matched target, empty if none matched.
+    Status status = UNKNOWN;
+    QList<QPair<QString, qint64>> timings; // Duration of each phase in nanoseconds, in order.
+};
+
+struct PatchReport {
+    QString error; // Reason patching was aborted, empty on success.
+    QList<FileReport> files;
+};
 
 class Patcher
 {
 public:
     static bool isPatched(QString path);
-    static bool patch(QWidget *parent, const QDir &dir);
-    static void undoPatch(const QDir &dir);
+    static bool patch(const QDir &dir, PatchReport *report = nullptr, PatchProgress *progress = nullptr);
+    static bool undoPatch(const QDir &dir, PatchReport *report = nullptr);
+    static void recover(const QDir &dir);
     static void generateConfigurationFile(const QDir &dir, const QNetworkInterface &interface);
 
 private:
+    static QMutex journalMutex;
+
     static bool copyFiles(const QDir &dir);
-    static bool patchFile(const QDir &dir, const FileEntry &fileEntry, const TargetEntry &target);
+    static FileReport patchEntry(const QDir &dir, const FileEntry &fileEntry, PatchProgress *progress);
+    static bool patchFile(const QDir &dir, const FileEntry &fileEntry, const TargetEntry &target, FileReport &fileReport, PatchProgress *progress = nullptr);
+    static bool writeFile(const QDir &dir, const FileEntry &fileEntry, const TargetEntry &target, const QString &outputFileName, FileReport &fileReport, CheckSum &checkSum, PatchProgress *progress);
+    static void writeJournal(const QDir &dir, const FileEntry &fileEntry, const QString &state);
+    static void clearJournal(const QDir &dir, const FileEntry &fileEntry);
 };
 
 #endif // PATCHER_H
@@ -0,0 +1,266 @@
+#include <algorithm>
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QDataStream>
+#include <QDebug>
+
+#include "patchplan.h"
+#include "peheader.h"
+#include "fileutils.h"
+#include "global.h"
+#include "patchdatabase.h"
+
+constexpr quint32 patch_plan_magic = 0x50504346; // "FCPP"
+constexpr quint32 patch_plan_version = 1;
+
+PatchPlan::PatchPlan(const PeFingerprint &source) :
+    source(source)
+{
+
+}
+
+bool PatchPlan::isEmpty() const
+{
+    return !compiled || writes.isEmpty();
+}
+
+const PeFingerprint &PatchPlan::getSource() const
+{
+    return source;
+}
+
+const QList<PatchPlan::Write> &PatchPlan::getWrites() const
+{
+    return writes;
+}
+
+qint64 PatchPlan::getFileSize() const
+{
+    return fileSize;
+}
+
+void PatchPlan::addWrite(qint64 offset, const QByteArray &data)
+{
+    writes.append({ offset, data });
+    compiled = false;
+}
+
+void PatchPlan::setFileSize(qint64 fileSize)
+{
+    this->fileSize = fileSize;
+    compiled = false;
+}
+
+bool PatchPlan::compile()
+{
+    std::sort(writes.begin(), writes.end(), [](const Write &first, const Write &second) {
+        return first.offset < second.offset;
+    });
+
+    // Bounds are checked once here, applying the plan just replays the writes.
+    qint64 end = 0;
+
+    for (const Write &write : writes) {
+        if (write.data.isEmpty() || write.offset < end || write.offset + write.data.length() > fileSize) {
+            qDebug().noquote() << QT_TR_NOOP(QString("Error: Patch plan write at offset %1 is out of bounds or overlapping.").arg(write.offset));
+            writes.clear();
+
+            return false;
+        }
+
+        end = write.offset + write.data.length();
+    }
+
+    compiled = !source.isEmpty();
+
+    return compiled;
+}
+
+bool PatchPlan::apply(const QString &fileName, const QString &outputFileName, PatchProgress *progress) const
+{
+    if (isEmpty()) {
+        return false;
+    }
+
+    bool inPlace = outputFileName.isEmpty() || outputFileName == fileName;
+    QFile file(fileName);
+
+    if (!file.open(inPlace ? QFile::ReadWrite : QFile::ReadOnly)) {
+        qDebug().noquote() << QT_TR_NOOP(QString("Cannot open: %1").arg(fileName));
+
+        return false;
+    }
+
+    // The offsets are only meaningful for the exact file the plan was compiled from.
+    if (PeHeader(&file).getFingerprint() != source) {
+        qDebug().noquote() << QT_TR_NOOP(QString("Patch plan does not match: %1").arg(fileName));
+
+        return false;
+    }
+
+    bool result = inPlace ? applyInPlace(file, progress) : applyTo(file, outputFileName, progress);
+
+    if (result) {
+        qDebug().noquote() << QT_TR_NOOP(QString("Applied patch plan of %1 writes to: %2").arg(writes.length()).arg(inPlace ? fileName : outputFileName));
+    } else {
+        qDebug().noquote() << QT_TR_NOOP(QString("Error: Failed writing to: %1").arg(inPlace ? fileName : outputFileName));
+    }
+
+    return result;
+}
+
+bool PatchPlan::applyInPlace(QFile &file, PatchProgress *progress) const
+{
+    for (const Write &write : writes) {
+        if (!file.seek(write.offset) || file.write(write.data) != write.data.length()) {
+            return false;
+        }
+
+        if (progress) {
+            progress->addBytesWritten(write.data.length());
+        }
+    }
+
+    return file.resize(fileSize) && file.flush();
+}
+
+bool PatchPlan::applyTo(QFile &file, const QString &outputFileName, PatchProgress *progress) const
+{
+    QFile outputFile(outputFileName);
+    qint64 sourceSize = file.size();
+    const uchar *data = sourceSize > 0 ? file.map(0, sourceSize) : nullptr;
+
+    if ((sourceSize > 0 && !data) || !outputFile.open(QFile::WriteOnly | QFile::Truncate)) {
+        return false;
+    }
+
+    qint64 position = 0;
+
+    auto addBytesWritten = [progress](qint64 bytes) {
+        if (progress) {
+            progress->addBytesWritten(bytes);
+        }
+    };
+
+    // Stream the original up to the given offset, zero filled past its end just like writing beyond the end in place would.
+    auto copyTo = [&outputFile, data, sourceSize, &position, &addBytesWritten](qint64 end) {
+        // Copy in chunks, so progress moves while the unchanged bulk of the file goes out.
+        constexpr qint64 chunkSize = 4 * 1024 * 1024;
+        qint64 copyEnd = qMin(end, sourceSize);
+
+        while (copyEnd > position) {
+            qint64 length = qMin(chunkSize, copyEnd - position);
+
+            if (outputFile.write(reinterpret_cast<const char*>(data + position), length) != length) {
+                return false;
+            }
+
+            position += length;
+            addBytesWritten(length);
+        }
+
+        if (end > position) {
+            if (outputFile.write(QByteArray(end - position, '\0')) != end - position) {
+                return false;
+            }
+
+            addBytesWritten(end - position);
+        }
+
+        position = end;
+
+        return true;
+    };
+
+    // Writes are sorted and never overlap, so this is one sequential pass over both files.
+    for (const Write &write : writes) {
+        if (!copyTo(write.offset) || outputFile.write(write.data) != write.data.length()) {
+            return false;
+        }
+
+        position += write.data.length();
+        addBytesWritten(write.data.length());
+    }
+
+    return copyTo(fileSize) && outputFile.flush();
+}
+
+bool PatchPlan::save(const QString &fileName) const
+{
+    if (isEmpty() || !QDir().mkpath(QFileInfo(fileName).absolutePath())) {
+        return false;
+    }
+
+    QSaveFile file(fileName);
+
+    if (!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << patch_plan_magic << patch_plan_version << QString(APP_VERSION);
+    stream << source.getFileSize() << source.getTimeDateStamp() << source.getSizeOfImage() << source.getNumberOfSections() << source.getSectionTableHash();
+    stream << fileSize << static_cast<quint32>(writes.length());
+
+    for (const Write &write : writes) {
+        stream << write.offset << write.data;
+    }
+
+    return stream.status() == QDataStream::Ok && file.commit();
+}
+
+PatchPlan PatchPlan::load(const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (!file.open(QFile::ReadOnly)) {
+        return PatchPlan();
+    }
+
+    QDataStream stream(&file);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic = 0;
+    quint32 version = 0;
+    QString appVersion;
+    stream >> magic >> version >> appVersion;
+
+    // Plans depend on the patch tables, so one written by another build is useless.
+    if (magic != patch_plan_magic || version != patch_plan_version || appVersion != APP_VERSION) {
+        return PatchPlan();
+    }
+
+    qint64 sourceFileSize = 0;
+    quint32 timeDateStamp = 0;
+    quint32 sizeOfImage = 0;
+    quint16 numberOfSections = 0;
+    quint32 sectionTableHash = 0;
+    stream >> sourceFileSize >> timeDateStamp >> sizeOfImage >> numberOfSections >> sectionTableHash;
+
+    PatchPlan plan(PeFingerprint(sourceFileSize, timeDateStamp, sizeOfImage, numberOfSections, sectionTableHash));
+    quint32 count = 0;
+    stream >> plan.fileSize >> count;
+
+    for (quint32 i = 0; i < count && stream.status() == QDataStream::Ok; i++) {
+        Write write;
+        stream >> write.offset >> write.data;
+        plan.writes.append(write);
+    }
+
+    // Validate again, a damaged plan must never write out of bounds.
+    if (stream.status() != QDataStream::Ok || !plan.compile()) {
+        return PatchPlan();
+    }
+
+    return plan;
+}
+
+QString PatchPlan::getCacheFileName(const CheckSum &checkSum)
+{
+    // Plans are compiled from the tables, so plans from another patch database must not be picked up.
+    return QDir(app_patch_plan_directory).filePath(PatchDatabase::getId() + "/" + FileUtils::toHex(checkSum) + app_patch_plan_suffix);
+}
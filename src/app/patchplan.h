@@ -0,0 +1,48 @@
+#ifndef PATCHPLAN_H
+#define PATCHPLAN_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QFile>
+
+#include "entry.h"
+#include "patchprogress.h"
+
+// Sorted list of positional writes that turns one exact input file into its patched form.
+// Compiled once from a patched PeFile and replayed later without parsing the PE again.
+class PatchPlan
+{
+public:
+    struct Write {
+        qint64 offset = 0;
+        QByteArray data;
+    };
+
+    PatchPlan() = default;
+    explicit PatchPlan(const PeFingerprint &source);
+
+    bool isEmpty() const;
+    const PeFingerprint &getSource() const;
+    const QList<Write> &getWrites() const;
+    qint64 getFileSize() const;
+    void addWrite(qint64 offset, const QByteArray &data);
+    void setFileSize(qint64 fileSize);
+    bool compile();
+    bool apply(const QString &fileName, const QString &outputFileName = QString(), PatchProgress *progress = nullptr) const;
+    bool save(const QString &fileName) const;
+
+    static PatchPlan load(const QString &fileName);
+    static QString getCacheFileName(const CheckSum &checkSum);
+
+private:
+    PeFingerprint source;
+    QList<Write> writes;
+    qint64 fileSize = 0;
+    bool compiled = false;
+
+    bool applyInPlace(QFile &file, PatchProgress *progress) const;
+    bool applyTo(QFile &file, const QString &outputFileName, PatchProgress *progress) const;
+};
+
+#endif // PATCHPLAN_H
@@ -0,0 +1,59 @@
+#include "patchprogress.h"
+
+PatchProgress::PatchProgress(QObject *parent) :
+    QObject(parent)
+{
+
+}
+
+void PatchProgress::reset()
+{
+    canceled = false;
+    bytesHashed = 0;
+    bytesWritten = 0;
+    totalBytes = 0;
+
+    update();
+}
+
+void PatchProgress::setTotalBytes(qint64 totalBytes)
+{
+    this->totalBytes = totalBytes;
+
+    update();
+}
+
+void PatchProgress::cancel()
+{
+    canceled = true;
+}
+
+bool PatchProgress::isCanceled() const
+{
+    return canceled;
+}
+
+void PatchProgress::startFile(const QString &fileName)
+{
+    emit fileStarted(fileName);
+}
+
+void PatchProgress::addBytesHashed(qint64 bytes)
+{
+    bytesHashed += bytes;
+
+    update();
+}
+
+void PatchProgress::addBytesWritten(qint64 bytes)
+{
+    bytesWritten += bytes;
+
+    update();
+}
+
+void PatchProgress::update()
+{
+    // Files are hashed and then written, so both count towards the total.
+    emit progressChanged(qMin<qint64>(bytesHashed + bytesWritten, totalBytes), totalBytes);
+}
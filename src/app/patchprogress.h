@@ -0,0 +1,38 @@
+#ifndef PATCHPROGRESS_H
+#define PATCHPROGRESS_H
+
+#include <atomic>
+
+#include <QObject>
+#include <QString>
+
+// Progress of a running patch, updated from worker threads and observed through signals.
+class PatchProgress : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PatchProgress(QObject *parent = nullptr);
+
+    void reset();
+    void setTotalBytes(qint64 totalBytes);
+    void cancel();
+    bool isCanceled() const;
+    void startFile(const QString &fileName);
+    void addBytesHashed(qint64 bytes);
+    void addBytesWritten(qint64 bytes);
+
+signals:
+    void fileStarted(const QString &fileName);
+    void progressChanged(qint64 bytes, qint64 totalBytes);
+
+private:
+    std::atomic<bool> canceled { false };
+    std::atomic<qint64> bytesHashed { 0 };
+    std::atomic<qint64> bytesWritten { 0 };
+    std::atomic<qint64> totalBytes { 0 };
+
+    void update();
+};
+
+#endif // PATCHPROGRESS_H
@@ -1,10 +1,19 @@
 #include <fstream>
+#include <istream>
+#include <algorithm>
 #include <cstring>
 
 #include <QByteArray>
 #include <QDebug>
+#include <QHash>
+#include <QtEndian>
 
 #include "pefile.h"
+#include "peheader.h"
+#include "hashstreambuffer.h"
+#include "memorystreambuffer.h"
+#include "signaturescanner.h"
+#include "fileutils.h"
 #include "global.h"
 
 PeFile::PeFile(const QFile &file, QObject *parent) :
@@ -24,17 +33,37 @@ PeFile::~PeFile()
 bool PeFile::read()
 { 
     // Open the file.
-    std::ifstream inputStream(file.fileName().toStdString(), std::ios::in | std::ios::binary);
+    QFile inputFile(file.fileName());
 
-    if (!inputStream) {
+    if (!inputFile.open(QFile::ReadOnly)) {
         qDebug().noquote() << QT_TR_NOOP(QString("Cannot open: %1").arg(file.fileName()));
 
         return false;
     }
 
+    // Parse from a read-only mapping instead of buffered stream reads. pe_bliss still copies every section out of it, so this
+    // saves the intermediate read buffer, not the section copies, and nothing is loaded lazily.
+    uchar *data = inputFile.map(0, inputFile.size());
+
+    if (!data) {
+        qDebug().noquote() << QT_TR_NOOP(QString("Cannot map: %1").arg(file.fileName()));
+
+        return false;
+    }
+
+    MemoryStreamBuffer streamBuffer(reinterpret_cast<const char*>(data), inputFile.size());
+    std::istream inputStream(&streamBuffer);
+
     try {
-        // Create an instance of a PE or PE + class using a factory
-        image = new pe_base(pe_factory::create_pe(inputStream));
+        // Create an instance of a PE or PE + class using a factory, debug directory contents are never used so skip copying them.
+        image = new pe_base(pe_factory::create_pe(inputStream, false));
+
+        // The image owns its own copy of the data now.
+        inputFile.unmap(data);
+
+        originalSectionCount = image->get_number_of_sections();
+        buildAddressIndex();
+        buildImportIndex();
     } catch (const pe_exception &exception) {
         qDebug().noquote() << QT_TR_NOOP(QString("Error: %1").arg(exception.what()));
 
@@ -44,7 +73,7 @@ bool PeFile::read()
     return true;
 }
 
-bool PeFile::apply(const QString &libraryName, const QString &libraryFile, const QStringList &libraryFunctions, const QList<CodeEntry> &codeEntries) const
+bool PeFile::apply(const QString &libraryName, const QString &libraryFile, const QStringList &libraryFunctions, const QList<CodeEntry> &codeEntries)
 {
     // Check that image is loaded.
     if (!image)
@@ -81,6 +110,7 @@ bool PeFile::apply(const QString &libraryName, const QString &libraryFile, const
     import_rebuilder_settings settings; // Modify the PE header and do not clear the IMAGE_DIRECTORY_ENTRY_IAT field.
     settings.fill_missing_original_iats(true); // Needed in order to preserve original IAT.
     rebuild_imports(*image, imports, attachedSection, settings);
+    buildImportIndex();
 
     // Add extra .text section.
     QByteArray textData;
@@ -108,32 +138,58 @@ bool PeFile::apply(const QString &libraryName, const QString &libraryFile, const
 
     }
 
-    // Patch code.
-    patchCode(libraryFile, libraryFunctions, codeEntries);
+    // Sections were added, so addresses have to be looked up again.
+    buildAddressIndex();
 
-    return true;
+    // Patch code, a write that does not fit its section leaves the image half patched.
+    return patchCode(libraryFile, libraryFunctions, codeEntries);
 }
 
-bool PeFile::write() const
+bool PeFile::write(CheckSum *checkSum, WriteMode mode, const QString &outputFileName, PatchProgress *progress) const
 {
     // Check that image is loaded.
     if (!image)
         return false;
 
+    // Without an output file name the input file is overwritten.
+    QString fileName = outputFileName.isEmpty() ? file.fileName() : outputFileName;
+
+    // Appending leaves nothing to hash on the way out, so only do it when no checksum is wanted.
+    if (mode == WRITE_APPEND && !checkSum) {
+        if (compilePlan().apply(file.fileName(), fileName, progress))
+            return true;
+
+        qDebug().noquote() << QT_TR_NOOP(QString("Cannot append to: %1, rebuilding PE instead.").arg(fileName));
+    }
+
     try {
         // Create a new PE file.
-        std::ofstream outputStream(file.fileName().toStdString(), std::ios::out | std::ios::binary | std::ios::trunc);
+        std::ofstream outputStream(fileName.toStdString(), std::ios::out | std::ios::binary | std::ios::trunc);
 
         if (!outputStream) {
-            qDebug().noquote() << QT_TR_NOOP(QString("Cannot create: %1").arg(file.fileName()));
+            qDebug().noquote() << QT_TR_NOOP(QString("Cannot create: %1").arg(fileName));
 
             return false;
         }
 
+        // Hash the image as it is written, so it never has to be read back.
+        HashStreamBuffer hashStreamBuffer(outputStream.rdbuf(), QCryptographicHash::Sha256, progress);
+        std::ostream hashStream(&hashStreamBuffer);
+
         // Rebuild PE file.
-        rebuild_pe(*image, outputStream);
+        rebuild_pe(*image, hashStream);
+        hashStream.flush();
+
+        if (!hashStream || !outputStream) {
+            qDebug().noquote() << QT_TR_NOOP(QString("Error: Failed writing to: %1").arg(fileName));
+
+            return false;
+        }
 
-        qDebug().noquote() << QT_TR_NOOP(QString("PE was rebuilt and saved to: %1").arg(file.fileName()));
+        if (checkSum)
+            *checkSum = FileUtils::toCheckSum(hashStreamBuffer.result());
+
+        qDebug().noquote() << QT_TR_NOOP(QString("PE was rebuilt and saved to: %1").arg(fileName));
     } catch (const pe_exception &exception) {
         qDebug().noquote() << QT_TR_NOOP(QString("Error: %1").arg(exception.what()));
 
@@ -143,101 +199,345 @@ bool PeFile::write() const
     return true;
 }
 
-QList<unsigned int> PeFile::buildSymbolAddressList(const QString &libraryFile) const
+PatchPlan PeFile::compilePlan() const
 {
-    QList<unsigned int> addresses;
+    QFile inputFile(file.fileName());
+
+    if (!image || !inputFile.open(QFile::ReadOnly)) {
+        qDebug().noquote() << QT_TR_NOOP(QString("Cannot open: %1").arg(file.fileName()));
 
-    // Loop thru all imported libraries.
-    for (const import_library &library : get_imported_functions(*image)) {
-        // Only build map for the selected target library.
-        if (library.get_name() == libraryFile.toStdString()) {
-            unsigned int address = image->get_image_base_32() + library.get_rva_to_iat();
+        return PatchPlan();
+    }
 
-            for (unsigned int i = 0; i < library.get_imported_functions().size(); i++) {
-                addresses.append(address);
-                address += 4; // Size of one address entry.
-            }
+    // Layout of the file on disk, which must still be the image that was read.
+    PeHeader header(&inputFile);
+    const section_list &sections = image->get_image_sections();
 
-            break;
+    if (!header.isValid() || header.getSections().length() != originalSectionCount || header.getFileAlignment() == 0 || header.getSectionAlignment() == 0) {
+        return PatchPlan();
+    }
+
+    auto alignUp = [](quint32 value, quint32 alignment) {
+        return (value + alignment - 1) / alignment * alignment;
+    };
+
+    auto toLittleEndian = [](quint32 value) {
+        QByteArray data(sizeof(quint32), '\0');
+        qToLittleEndian(value, data.data());
+
+        return data;
+    };
+
+    // New section headers have to fit in the zero padding between the section table and the first section.
+    qint64 tableOffset = header.getSectionTableOffset() + originalSectionCount * 40;
+    qint64 tableEnd = header.getSectionTableOffset() + static_cast<qint64>(sections.size()) * 40;
+    qint64 firstRawData = header.getSizeOfHeaders();
+    quint32 rawDataEnd = 0;
+
+    for (const PeHeader::Section &section : header.getSections()) {
+        if (section.sizeOfRawData > 0) {
+            firstRawData = qMin<qint64>(firstRawData, section.pointerToRawData);
+            rawDataEnd = qMax(rawDataEnd, section.pointerToRawData + section.sizeOfRawData);
         }
     }
 
-    return addresses;
+    if (tableEnd > firstRawData || !inputFile.seek(tableOffset) || inputFile.read(tableEnd - tableOffset) != QByteArray(tableEnd - tableOffset, '\0')) {
+        qDebug().noquote() << QT_TR_NOOP(QString("No room for new section headers in: %1").arg(file.fileName()));
+
+        return PatchPlan();
+    }
+
+    PatchPlan plan(header.getFingerprint());
+
+    // Rewrite only the bytes that were patched in existing sections.
+    quint32 firstNewAddress = sections.size() > static_cast<size_t>(originalSectionCount) ? sections[originalSectionCount].get_virtual_address() : header.getSizeOfImage();
+
+    for (const QPair<quint32, quint32> &range : patchedRanges) {
+        if (range.first >= firstNewAddress)
+            continue;
+
+        qint64 offset = header.rvaToFileOffset(range.first, range.second);
+
+        if (offset < 0)
+            return PatchPlan();
+
+        try {
+            const section &section = image->section_from_rva(range.first);
+            quint32 sectionOffset = range.first - section.get_virtual_address();
+
+            if (sectionOffset + range.second > section.get_raw_data().size())
+                return PatchPlan();
+
+            plan.addWrite(offset, QByteArray(section.get_raw_data().data() + sectionOffset, range.second));
+        } catch (const pe_exception &exception) {
+            qDebug().noquote() << QT_TR_NOOP(QString("Error: %1").arg(exception.what()));
+
+            return PatchPlan();
+        }
+    }
+
+    // Append new sections after the last raw data, dropping any overlay just like a rebuild would.
+    quint32 appendOffset = alignUp(rawDataEnd, header.getFileAlignment());
+    quint32 sizeOfImage = header.getSizeOfImage();
+    QByteArray sectionTable;
+
+    for (size_t i = originalSectionCount; i < sections.size(); i++) {
+        const section &section = sections[i];
+        QByteArray rawData = QByteArray::fromStdString(section.get_raw_data());
+        quint32 sizeOfRawData = alignUp(rawData.length(), header.getFileAlignment());
+        quint32 virtualSize = qMax<quint32>(section.get_virtual_size(), rawData.length());
+
+        rawData.append(QByteArray(sizeOfRawData - rawData.length(), '\0'));
+        plan.addWrite(appendOffset, rawData);
+
+        QByteArray name = QByteArray::fromStdString(section.get_name()).left(8);
+        sectionTable.append(name + QByteArray(8 - name.length(), '\0'));
+        sectionTable.append(toLittleEndian(virtualSize));
+        sectionTable.append(toLittleEndian(section.get_virtual_address()));
+        sectionTable.append(toLittleEndian(sizeOfRawData));
+        sectionTable.append(toLittleEndian(appendOffset));
+        sectionTable.append(QByteArray(12, '\0')); // No relocations or line numbers.
+        sectionTable.append(toLittleEndian(section.get_characteristics()));
+
+        appendOffset += sizeOfRawData;
+        sizeOfImage = qMax(sizeOfImage, alignUp(section.get_virtual_address() + virtualSize, header.getSectionAlignment()));
+    }
+
+    if (!sectionTable.isEmpty())
+        plan.addWrite(tableOffset, sectionTable);
+
+    // NumberOfSections in the file header, then SizeOfImage and the data directories in the optional header.
+    QByteArray numberOfSections(sizeof(quint16), '\0');
+    qToLittleEndian<quint16>(sections.size(), numberOfSections.data());
+    plan.addWrite(header.getOptionalHeaderOffset() - 18, numberOfSections);
+    plan.addWrite(header.getOptionalHeaderOffset() + 56, toLittleEndian(sizeOfImage));
+
+    QByteArray directories;
+
+    for (int i = 0; i < header.getDirectoryCount(); i++) {
+        directories.append(toLittleEndian(image->get_directory_rva(i)) + toLittleEndian(image->get_directory_size(i)));
+    }
+
+    if (!directories.isEmpty())
+        plan.addWrite(header.getOptionalHeaderOffset() + 96, directories);
+
+    plan.setFileSize(appendOffset);
+
+    return plan.compile() ? plan : PatchPlan();
 }
 
-bool PeFile::patchCode(const QString &libraryFile, const QStringList &libraryFunctions, const QList<CodeEntry> &codeEntries) const
+QList<CodeEntry> PeFile::findCallSites(const QList<QPair<QString, QString>> &functions) const
 {
-    // Get a compiled list of all functiona addreses.
-    const QList<unsigned int> &symbolAddressList = buildSymbolAddressList(libraryFile);
+    // Winsock exports these by the same ordinals in every version, some images import them that way.
+    static const QHash<QString, quint16> winsockOrdinals = {
+        { "bind", 2 },
+        { "connect", 4 },
+        { "sendto", 20 },
+        { "gethostbyname", 52 }
+    };
+
+    QList<CodeEntry> codeEntries;
+
+    if (!image) {
+        return codeEntries;
+    }
 
-    for (section &section : image->get_image_sections()) {
-        qDebug().noquote() << QT_TR_NOOP(QString("Entering section: \"%1\"").arg(QString::fromStdString(section.get_name())));
+    unsigned int imageBase = image->get_image_base_32();
+    QHash<quint32, int> iatSlots; // Address of an import slot to the index of its function.
 
-        // Getting the base image address for later use.
-        unsigned int sectionAddress = image->get_image_base_32() + section.get_virtual_address();
+    for (int i = 0; i < functions.length(); i++) {
+        quint32 address = importIndex.find(functions[i].first, functions[i].second);
 
-        // Read raw data of section as byte array.
-        unsigned char *rawDataPtr = reinterpret_cast<unsigned char*>(&section.get_raw_data()[0]); // NOTE: Seems to be same as section.get_virtual_data(0)[0];
+        if (address == 0 && functions[i].first.startsWith("ws2_32", Qt::CaseInsensitive) && winsockOrdinals.contains(functions[i].second)) {
+            address = importIndex.find(functions[i].first, winsockOrdinals.value(functions[i].second));
+        }
 
-        // Patching all addresses specified for this target.
-        for (const CodeEntry &codeEntry : codeEntries) {
-            // Only patch addresses in their specified section.
-            if (section.get_name() != codeEntry.getSection().toStdString())
-                continue;
+        if (address != 0) {
+            iatSlots.insert(address, i);
+        }
+    }
 
-            unsigned int address = codeEntry.getAddress();
-            QByteArray data = codeEntry.getData();
+    // Imported functions are called through "call dword ptr [slot]" or reached through "jmp dword ptr [slot]" thunks.
+    const SignatureScanner scanners[] = {
+        SignatureScanner("FF 15 ?? ?? ?? ??"),
+        SignatureScanner("FF 25 ?? ?? ?? ??")
+    };
 
-            // If address is zero, that means this function is not use for this file.
-            if (address == 0)
-                continue;
+    for (const section &section : image->get_image_sections()) {
+        if (!section.executable()) {
+            continue;
+        }
 
-            // Creating pointer to the data that is to be updated (aka. does pointer yoga).
-            unsigned int *basePtr = reinterpret_cast<unsigned int*>(rawDataPtr + address - sectionAddress);
+        const std::string &rawData = section.get_raw_data();
+        QString sectionName = QString::fromStdString(section.get_name());
 
-            // Handle symbols differently from data.
-            switch (codeEntry.getType()) {
-            case CodeEntry::INJECT_SYMBOL:
-                {
-                    int index = data.toInt();
-                    unsigned int functionAddress = symbolAddressList[index];
+        for (const SignatureScanner &scanner : scanners) {
+            for (qint64 offset = scanner.find(rawData.data(), rawData.size()); offset >= 0; offset = scanner.find(rawData.data(), rawData.size(), offset + 1)) {
+                QHash<quint32, int>::const_iterator iterator = iatSlots.constFind(qFromLittleEndian<quint32>(rawData.data() + offset + 2));
 
-                    // Verify to some degree addresses to be patched.
-                    if (functionAddress == 0) {
-                        qDebug().noquote() << QT_TR_NOOP(QString("Error: Address is zero, something went wrong! Aborting."));
+                // The operand is what gets patched, it follows the two opcode bytes.
+                if (iterator != iatSlots.constEnd()) {
+                    codeEntries.append(CodeEntry(imageBase + section.get_virtual_address() + static_cast<quint32>(offset) + 2, static_cast<uint32_t>(iterator.value()), sectionName));
+                }
+            }
+        }
+    }
 
-                        return false;
-                    }
+    std::sort(codeEntries.begin(), codeEntries.end(), [](const CodeEntry &a, const CodeEntry &b) {
+        return a.getAddress() < b.getAddress();
+    });
 
-                    qDebug().noquote() << QT_TR_NOOP(QString("Patched function call at address 0x%1, new function is \"%2\" with address of 0x%3.").arg(address, 0, 16).arg(libraryFunctions[index]).arg(functionAddress, 0, 16));
+    return codeEntries;
+}
+
+void PeFile::buildImportIndex()
+{
+    importIndex.clear();
+
+    try {
+        // Parsing the import directory copies every name, so do it once per layout rather than on every lookup.
+        for (const import_library &library : get_imported_functions(*image)) {
+            QString libraryName = QString::fromStdString(library.get_name());
+            quint32 address = image->get_image_base_32() + library.get_rva_to_iat();
+
+            for (const imported_function &function : library.get_imported_functions()) {
+                importIndex.insert(libraryName, function.has_name() ? QString::fromStdString(function.get_name()) : QString(), function.has_name() ? 0 : function.get_ordinal(), address);
+                address += sizeof(quint32); // Size of one address entry.
+            }
+        }
+    } catch (const pe_exception &exception) {
+        qDebug().noquote() << QT_TR_NOOP(QString("Error: Could not read imports: %1").arg(exception.what()));
+    }
+}
+
+void PeFile::buildAddressIndex()
+{
+    const section_list &sections = image->get_image_sections();
+    addressIndex.clear();
+
+    // Index the raw data actually held in memory, that is what gets patched.
+    for (size_t i = 0; i < sections.size(); i++) {
+        addressIndex.insert(static_cast<int>(i), sections[i].get_virtual_address(), static_cast<quint32>(sections[i].get_raw_data().size()));
+    }
+}
+
+bool PeFile::resolveSites(QList<CodeEntry> &codeEntries) const
+{
+    for (CodeEntry &codeEntry : codeEntries) {
+        if (codeEntry.getSignature().isEmpty()) {
+            continue;
+        }
+
+        SignatureScanner scanner(codeEntry.getSignature());
+        qint64 offset = -1;
+        unsigned int sectionAddress = 0;
+
+        for (const section &section : image->get_image_sections()) {
+            if (codeEntry.getSection() == QLatin1String(section.get_name().c_str())) {
+                const std::string &rawData = section.get_raw_data();
+                offset = scanner.findUnique(rawData.data(), rawData.size());
+                sectionAddress = image->get_image_base_32() + section.get_virtual_address();
 
-                    // Change the old address to point to new function instead.
-                    unsigned int *dataPtr = reinterpret_cast<unsigned int*>(basePtr);
-                    *dataPtr = functionAddress;
-                }
                 break;
+            }
+        }
+
+        if (offset < 0) {
+            qDebug().noquote() << QT_TR_NOOP(QString("Error: Signature \"%1\" not found exactly once in section \"%2\"! Aborting.").arg(codeEntry.getSignature().constData()).arg(codeEntry.getSection()));
+
+            return false;
+        }
+
+        unsigned int address = sectionAddress + static_cast<unsigned int>(offset) + codeEntry.getSignatureOffset();
+
+        if (address != codeEntry.getAddress()) {
+            qDebug().noquote() << QT_TR_NOOP(QString("Signature \"%1\" found at address 0x%2.").arg(codeEntry.getSignature().constData()).arg(address, 0, 16));
+        }
+
+        codeEntry.setAddress(address);
+    }
 
-            case CodeEntry::INJECT_DATA:
-                {
-                    // Change the value at the address to the gived code.
-                    char *dataPtr = reinterpret_cast<char*>(basePtr);
+    return true;
+}
+
+bool PeFile::patchCode(const QString &libraryFile, const QStringList &libraryFunctions, const QList<CodeEntry> &targetCodeEntries)
+{
+    section_list &sections = image->get_image_sections();
+    unsigned int imageBase = image->get_image_base_32();
+    QList<CodeEntry> codeEntries = targetCodeEntries;
+
+    // Locate every signature before anything is written, so patching one site cannot hide another.
+    if (!resolveSites(codeEntries)) {
+        return false;
+    }
+
+    // Patching all addresses specified for this target.
+    for (const CodeEntry &codeEntry : codeEntries) {
+        unsigned int address = codeEntry.getAddress();
+        const QByteArray &data = codeEntry.getData();
 
-                    if (data.length() <= 0) {
-                        qDebug().noquote() << QT_TR_NOOP(QString("Error: Data length is zero, something went wrong! Aborting."));
+        // If address is zero, that means this function is not use for this file.
+        if (address == 0 || codeEntry.getType() == CodeEntry::NEW_DATA)
+            continue;
 
-                        return false;
-                    }
+        if (codeEntry.getType() == CodeEntry::INJECT_DATA && data.length() <= 0) {
+            qDebug().noquote() << QT_TR_NOOP(QString("Error: Data length is zero, something went wrong! Aborting."));
+
+            return false;
+        }
+
+        // Look up where the address lives, the whole write must fit in its specified section.
+        unsigned int length = codeEntry.getType() == CodeEntry::INJECT_SYMBOL ? sizeof(unsigned int) : data.length();
+        AddressIndex::Location location = address >= imageBase ? addressIndex.find(address - imageBase, length) : AddressIndex::Location();
+
+        if (!location.isValid() || codeEntry.getSection() != QLatin1String(sections[location.section].get_name().c_str())) {
+            qDebug().noquote() << QT_TR_NOOP(QString("Error: Address 0x%1 with length %2 is not inside section \"%3\"! Aborting.").arg(address, 0, 16).arg(length).arg(codeEntry.getSection()));
+
+            return false;
+        }
 
-                    qDebug().noquote() << QT_TR_NOOP(QString("Patched data at address 0x%1, changed from \"%2\" to \"%3\", offset from address is %4.").arg(address, 0, 16).arg(QByteArray(dataPtr, data.length()).toHex().constData()).arg(data.toHex().constData()).arg(data.length()));
+        // Creating pointer to the data that is to be updated.
+        char *dataPtr = &sections[location.section].get_raw_data()[location.offset];
 
-                    // Copy data
-                    std::memcpy(dataPtr, data.constData(), data.length());
+        // Handle symbols differently from data.
+        switch (codeEntry.getType()) {
+        case CodeEntry::INJECT_SYMBOL:
+            {
+                int index = data.toInt();
+                unsigned int functionAddress = index >= 0 && index < libraryFunctions.length() ? importIndex.find(libraryFile, libraryFunctions[index]) : 0;
+
+                // Verify to some degree addresses to be patched.
+                if (functionAddress == 0) {
+                    qDebug().noquote() << QT_TR_NOOP(QString("Error: Address is zero, something went wrong! Aborting."));
+
+                    return false;
                 }
-                break;
 
-            default:
-                break;
+                qDebug().noquote() << QT_TR_NOOP(QString("Patched function call at address 0x%1, new function is \"%2\" with address of 0x%3.").arg(address, 0, 16).arg(libraryFunctions[index]).arg(functionAddress, 0, 16));
+
+                // Change the old address to point to new function instead.
+                std::memcpy(dataPtr, &functionAddress, sizeof(functionAddress));
             }
+            break;
+
+        case CodeEntry::INJECT_DATA:
+            {
+                qDebug().noquote() << QT_TR_NOOP(QString("Patched data at address 0x%1, changed from \"%2\" to \"%3\", offset from address is %4.").arg(address, 0, 16).arg(QByteArray(dataPtr, data.length()).toHex().constData()).arg(data.toHex().constData()).arg(data.length()));
+
+                // Copy data
+                std::memcpy(dataPtr, data.constData(), data.length());
+            }
+            break;
+
+        default:
+            break;
+        }
+
+        // Patching again writes the same ranges, which the plan would otherwise reject as overlapping.
+        QPair<quint32, quint32> range(address - imageBase, length);
+
+        if (!patchedRanges.contains(range)) {
+            patchedRanges.append(range);
         }
     }
 
@@ -6,10 +6,15 @@
 #include <QString>
 #include <QStringList>
 #include <QList>
+#include <QPair>
 
 #include <pe_bliss.h>
 
 #include "entry.h"
+#include "patchplan.h"
+#include "patchprogress.h"
+#include "addressindex.h"
+#include "importindex.h"
 
 using namespace pe_bliss;
 
@@ -18,19 +23,32 @@ class PeFile : public QObject
     Q_OBJECT
 
 public:
+    enum WriteMode {
+        WRITE_REBUILD, // Serialize the whole image again.
+        WRITE_APPEND   // Only touch headers and patched bytes, append new sections to the file on disk.
+    };
+
     explicit PeFile(const QFile &file, QObject *parent = nullptr);
     ~PeFile();
 
-    bool apply(const QString &libraryName, const QString &libraryFile, const QStringList &libraryFunctions, const QList<CodeEntry> &codeEntries) const;
-    bool write() const;
+    bool apply(const QString &libraryName, const QString &libraryFile, const QStringList &libraryFunctions, const QList<CodeEntry> &codeEntries);
+    bool write(CheckSum *checkSum = nullptr, WriteMode mode = WRITE_REBUILD, const QString &outputFileName = QString(), PatchProgress *progress = nullptr) const;
+    bool patchCode(const QString &libraryFile, const QStringList &libraryFunctions, const QList<CodeEntry> &codeEntries);
+    PatchPlan compilePlan() const;
+    QList<CodeEntry> findCallSites(const QList<QPair<QString, QString>> &functions) const;
 
 private:
     const QFile &file;
     pe_base *image = nullptr;
+    int originalSectionCount = 0;
+    AddressIndex addressIndex;
+    ImportIndex importIndex;
+    QList<QPair<quint32, quint32>> patchedRanges; // RVA and length of every byte range changed in existing sections.
 
     bool read();
-    QList<unsigned int> buildSymbolAddressList(const QString &libraryFile) const;
-    bool patchCode(const QString &libraryFile, const QStringList &libraryFunctions, const QList<CodeEntry> &codeEntries) const;
+    void buildAddressIndex();
+    void buildImportIndex();
+    bool resolveSites(QList<CodeEntry> &codeEntries) const;
 };
 
 #endif // PEFILE_H
@@ -0,0 +1,245 @@
+#include <QFile>
+#include <QtEndian>
+
+#include "peheader.h"
+
+// Sizes and offsets from the PE/COFF specification, only PE32 (x86) images are supported.
+constexpr quint16 pe_dos_signature = 0x5a4d; // "MZ"
+constexpr quint32 pe_nt_signature = 0x00004550; // "PE\0\0"
+constexpr quint16 pe_machine_i386 = 0x014c;
+constexpr quint16 pe_optional_header_magic_32 = 0x010b;
+constexpr int pe_dos_header_size = 64;
+constexpr int pe_dos_header_lfanew = 0x3c;
+constexpr int pe_file_header_size = 20;
+constexpr int pe_optional_header_size_32 = 96;
+constexpr int pe_section_header_size = 40;
+constexpr int pe_data_directory_count = 16;
+constexpr int pe_data_directory_size = 8;
+
+PeHeader::PeHeader(const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (file.open(QFile::ReadOnly)) {
+        valid = read(&file);
+        file.close();
+    }
+}
+
+PeHeader::PeHeader(QIODevice *device)
+{
+    valid = read(device);
+}
+
+bool PeHeader::read(QIODevice *device)
+{
+    fileSize = device->size();
+
+    // DOS header, only needed to find the NT headers.
+    QByteArray dosHeader = device->read(pe_dos_header_size);
+
+    if (dosHeader.length() != pe_dos_header_size || qFromLittleEndian<quint16>(dosHeader.constData()) != pe_dos_signature) {
+        return false;
+    }
+
+    quint32 ntHeaderOffset = qFromLittleEndian<quint32>(dosHeader.constData() + pe_dos_header_lfanew);
+
+    if (!device->seek(ntHeaderOffset)) {
+        return false;
+    }
+
+    // NT signature followed by the file header.
+    QByteArray fileHeader = device->read(sizeof(quint32) + pe_file_header_size);
+
+    if (fileHeader.length() != sizeof(quint32) + pe_file_header_size || qFromLittleEndian<quint32>(fileHeader.constData()) != pe_nt_signature) {
+        return false;
+    }
+
+    const char *fileHeaderPtr = fileHeader.constData() + sizeof(quint32);
+    quint16 machine = qFromLittleEndian<quint16>(fileHeaderPtr);
+    quint16 numberOfSections = qFromLittleEndian<quint16>(fileHeaderPtr + 2);
+    quint16 sizeOfOptionalHeader = qFromLittleEndian<quint16>(fileHeaderPtr + 16);
+    timeDateStamp = qFromLittleEndian<quint32>(fileHeaderPtr + 4);
+
+    if (machine != pe_machine_i386 || sizeOfOptionalHeader < pe_optional_header_size_32) {
+        return false;
+    }
+
+    QByteArray optionalHeader = device->read(sizeOfOptionalHeader);
+
+    if (optionalHeader.length() != sizeOfOptionalHeader || qFromLittleEndian<quint16>(optionalHeader.constData()) != pe_optional_header_magic_32) {
+        return false;
+    }
+
+    optionalHeaderOffset = ntHeaderOffset + sizeof(quint32) + pe_file_header_size;
+    sectionTableOffset = optionalHeaderOffset + sizeOfOptionalHeader;
+    imageBase = qFromLittleEndian<quint32>(optionalHeader.constData() + 28);
+    sectionAlignment = qFromLittleEndian<quint32>(optionalHeader.constData() + 32);
+    fileAlignment = qFromLittleEndian<quint32>(optionalHeader.constData() + 36);
+    sizeOfImage = qFromLittleEndian<quint32>(optionalHeader.constData() + 56);
+    sizeOfHeaders = qFromLittleEndian<quint32>(optionalHeader.constData() + 60);
+
+    // Data directories trail the fixed part of the optional header.
+    quint32 numberOfRvaAndSizes = qMin<quint32>(qFromLittleEndian<quint32>(optionalHeader.constData() + 92), pe_data_directory_count);
+
+    for (quint32 i = 0; i < numberOfRvaAndSizes && pe_optional_header_size_32 + (i + 1) * pe_data_directory_size <= sizeOfOptionalHeader; i++) {
+        const char *directoryPtr = optionalHeader.constData() + pe_optional_header_size_32 + i * pe_data_directory_size;
+        directories.append({ qFromLittleEndian<quint32>(directoryPtr), qFromLittleEndian<quint32>(directoryPtr + 4) });
+    }
+
+    // Section table follows directly after the optional header.
+    QByteArray sectionTable = device->read(numberOfSections * pe_section_header_size);
+
+    if (sectionTable.length() != numberOfSections * pe_section_header_size) {
+        return false;
+    }
+
+    for (int i = 0; i < numberOfSections; i++) {
+        const char *sectionPtr = sectionTable.constData() + i * pe_section_header_size;
+        Section section;
+        section.name = QByteArray(sectionPtr, qstrnlen(sectionPtr, 8));
+        section.virtualSize = qFromLittleEndian<quint32>(sectionPtr + 8);
+        section.virtualAddress = qFromLittleEndian<quint32>(sectionPtr + 12);
+        section.sizeOfRawData = qFromLittleEndian<quint32>(sectionPtr + 16);
+        section.pointerToRawData = qFromLittleEndian<quint32>(sectionPtr + 20);
+        section.characteristics = qFromLittleEndian<quint32>(sectionPtr + 36);
+        sections.append(section);
+        addressIndex.insert(i, section.virtualAddress, section.sizeOfRawData, section.pointerToRawData);
+    }
+
+    return true;
+}
+
+bool PeHeader::isValid() const
+{
+    return valid;
+}
+
+qint64 PeHeader::getFileSize() const
+{
+    return fileSize;
+}
+
+quint32 PeHeader::getTimeDateStamp() const
+{
+    return timeDateStamp;
+}
+
+quint32 PeHeader::getImageBase() const
+{
+    return imageBase;
+}
+
+quint32 PeHeader::getSectionAlignment() const
+{
+    return sectionAlignment;
+}
+
+quint32 PeHeader::getFileAlignment() const
+{
+    return fileAlignment;
+}
+
+quint32 PeHeader::getSizeOfImage() const
+{
+    return sizeOfImage;
+}
+
+quint32 PeHeader::getSizeOfHeaders() const
+{
+    return sizeOfHeaders;
+}
+
+qint64 PeHeader::getOptionalHeaderOffset() const
+{
+    return optionalHeaderOffset;
+}
+
+qint64 PeHeader::getSectionTableOffset() const
+{
+    return sectionTableOffset;
+}
+
+int PeHeader::getDirectoryCount() const
+{
+    return directories.length();
+}
+
+const QList<PeHeader::Section> &PeHeader::getSections() const
+{
+    return sections;
+}
+
+const PeHeader::Section *PeHeader::findSection(const QString &name) const
+{
+    for (const Section &section : sections) {
+        if (section.name == name.toLatin1()) {
+            return &section;
+        }
+    }
+
+    return nullptr;
+}
+
+quint32 PeHeader::getSectionTableHash(int count) const
+{
+    // FNV-1a over the layout of the first count sections, patched files only append to the table.
+    quint32 hash = 2166136261u;
+
+    auto append = [&hash](quint32 value) {
+        for (int i = 0; i < 4; i++) {
+            hash = (hash ^ ((value >> (i * 8)) & 0xff)) * 16777619u;
+        }
+    };
+
+    for (int i = 0; i < qMin(count, sections.length()); i++) {
+        const Section &section = sections[i];
+
+        for (char character : section.name) {
+            hash = (hash ^ static_cast<quint8>(character)) * 16777619u;
+        }
+
+        append(section.virtualSize);
+        append(section.virtualAddress);
+        append(section.sizeOfRawData);
+        append(section.pointerToRawData);
+    }
+
+    return hash;
+}
+
+PeFingerprint PeHeader::getFingerprint() const
+{
+    return PeFingerprint(fileSize, timeDateStamp, sizeOfImage, sections.length(), getSectionTableHash(sections.length()));
+}
+
+quint32 PeHeader::getDirectoryRva(DataDirectory directory) const
+{
+    return directory < directories.length() ? directories[directory].first : 0;
+}
+
+quint32 PeHeader::getDirectorySize(DataDirectory directory) const
+{
+    return directory < directories.length() ? directories[directory].second : 0;
+}
+
+qint64 PeHeader::rvaToFileOffset(quint32 rva, quint32 length) const
+{
+    // The whole range must be backed by raw data of a single section.
+    AddressIndex::Location location = addressIndex.find(rva, length);
+
+    if (!location.isValid() || location.fileOffset + length > fileSize) {
+        return -1;
+    }
+
+    return location.fileOffset;
+}
+
+qint64 PeHeader::vaToFileOffset(quint32 address, quint32 length) const
+{
+    if (address < imageBase) {
+        return -1;
+    }
+
+    return rvaToFileOffset(address - imageBase, length);
+}
@@ -0,0 +1,71 @@
+#ifndef PEHEADER_H
+#define PEHEADER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QIODevice>
+#include <QPair>
+
+#include "entry.h"
+#include "addressindex.h"
+
+class PeHeader
+{
+public:
+    struct Section {
+        QByteArray name;
+        quint32 virtualSize = 0;
+        quint32 virtualAddress = 0;
+        quint32 sizeOfRawData = 0;
+        quint32 pointerToRawData = 0;
+        quint32 characteristics = 0;
+    };
+
+    enum DataDirectory {
+        DIRECTORY_IMPORT = 1,
+        DIRECTORY_IAT = 12
+    };
+
+    explicit PeHeader(const QString &fileName);
+    explicit PeHeader(QIODevice *device);
+
+    bool isValid() const;
+    qint64 getFileSize() const;
+    quint32 getTimeDateStamp() const;
+    quint32 getImageBase() const;
+    quint32 getSectionAlignment() const;
+    quint32 getFileAlignment() const;
+    quint32 getSizeOfImage() const;
+    quint32 getSizeOfHeaders() const;
+    qint64 getOptionalHeaderOffset() const;
+    qint64 getSectionTableOffset() const;
+    int getDirectoryCount() const;
+    const QList<Section> &getSections() const;
+    const Section *findSection(const QString &name) const;
+    quint32 getSectionTableHash(int count) const;
+    PeFingerprint getFingerprint() const;
+    quint32 getDirectoryRva(DataDirectory directory) const;
+    quint32 getDirectorySize(DataDirectory directory) const;
+    qint64 rvaToFileOffset(quint32 rva, quint32 length) const;
+    qint64 vaToFileOffset(quint32 address, quint32 length) const;
+
+private:
+    bool valid = false;
+    qint64 fileSize = 0;
+    quint32 timeDateStamp = 0;
+    quint32 imageBase = 0;
+    quint32 sectionAlignment = 0;
+    quint32 fileAlignment = 0;
+    quint32 sizeOfImage = 0;
+    quint32 sizeOfHeaders = 0;
+    qint64 optionalHeaderOffset = 0;
+    qint64 sectionTableOffset = 0;
+    QList<Section> sections;
+    AddressIndex addressIndex;
+    QList<QPair<quint32, quint32>> directories;
+
+    bool read(QIODevice *device);
+};
+
+#endif // PEHEADER_H
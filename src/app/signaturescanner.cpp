@@ -0,0 +1,163 @@
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIGNATURESCANNER_SSE2
+#include <emmintrin.h>
+#endif
+
+#include <QList>
+#include <QtAlgorithms>
+
+#include "signaturescanner.h"
+
+SignatureScanner::SignatureScanner(const QByteArray &signature)
+{
+    const QList<QByteArray> tokens = signature.simplified().split(' ');
+
+    for (const QByteArray &token : tokens) {
+        if (token == "?" || token == "??") {
+            bytes.append('\0');
+            mask.append('\0');
+
+            continue;
+        }
+
+        bool ok = false;
+        uint value = token.toUInt(&ok, 16);
+
+        if (!ok || token.length() != 2) {
+            bytes.clear();
+            mask.clear();
+
+            return;
+        }
+
+        bytes.append(static_cast<char>(value));
+        mask.append('\1');
+    }
+
+    // Anchor on the longest run of fixed bytes, the longer it is the fewer false candidates.
+    for (int i = 0; i < mask.length();) {
+        int run = 0;
+
+        while (i + run < mask.length() && mask[i + run]) {
+            run++;
+        }
+
+        if (run > anchorLength) {
+            anchorOffset = i;
+            anchorLength = run;
+        }
+
+        i += qMax(run, 1);
+    }
+
+    skip.fill(anchorLength);
+
+    for (int i = 0; i < anchorLength - 1; i++) {
+        skip[static_cast<uchar>(bytes[anchorOffset + i])] = anchorLength - 1 - i;
+    }
+}
+
+bool SignatureScanner::isValid() const
+{
+    // A signature of only wildcards would match anywhere.
+    return anchorLength > 0;
+}
+
+int SignatureScanner::length() const
+{
+    return bytes.length();
+}
+
+qint64 SignatureScanner::find(const char *data, qint64 size, qint64 from) const
+{
+    if (!isValid() || from < 0 || size - from < bytes.length()) {
+        return -1;
+    }
+
+    // Anchor positions for which the whole signature still fits.
+    qint64 anchorFrom = from + anchorOffset;
+    qint64 anchorEnd = size - bytes.length() + anchorOffset + anchorLength;
+
+    for (qint64 position = findAnchor(data, anchorFrom, anchorEnd); position >= 0; position = findAnchor(data, position + 1, anchorEnd)) {
+        if (matches(data + position - anchorOffset)) {
+            return position - anchorOffset;
+        }
+    }
+
+    return -1;
+}
+
+int SignatureScanner::count(const char *data, qint64 size, int limit) const
+{
+    int result = 0;
+
+    // Stop early, callers only care whether a signature is unique.
+    for (qint64 position = find(data, size); position >= 0 && result < limit; position = find(data, size, position + 1)) {
+        result++;
+    }
+
+    return result;
+}
+
+qint64 SignatureScanner::findUnique(const char *data, qint64 size) const
+{
+    qint64 offset = find(data, size);
+
+    // Taking the wrong one of several matches would be worse than not finding any.
+    return offset >= 0 && find(data, size, offset + 1) < 0 ? offset : -1;
+}
+
+bool SignatureScanner::matches(const char *data) const
+{
+    for (int i = 0; i < bytes.length(); i++) {
+        if (mask[i] && data[i] != bytes[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+qint64 SignatureScanner::findAnchor(const char *data, qint64 from, qint64 end) const
+{
+    const char *anchor = bytes.constData() + anchorOffset;
+    qint64 last = anchorLength - 1;
+    qint64 position = from;
+
+#ifdef SIGNATURESCANNER_SSE2
+    // Compare the first and last anchor byte at 16 positions at once, only positions where both match are compared in full.
+    const __m128i first = _mm_set1_epi8(anchor[0]);
+    const __m128i final = _mm_set1_epi8(anchor[last]);
+
+    for (; position + last + 16 <= end; position += 16) {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + position + last));
+        unsigned int candidates = static_cast<unsigned int>(_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, final))));
+
+        while (candidates) {
+            int bit = qCountTrailingZeroBits(candidates);
+
+            if (std::memcmp(data + position + bit, anchor, anchorLength) == 0) {
+                return position + bit;
+            }
+
+            candidates &= candidates - 1;
+        }
+    }
+#endif
+
+    // Horspool for whatever is left, or everything without SSE2.
+    while (position + last < end) {
+        char character = data[position + last];
+
+        if (character == anchor[last] && std::memcmp(data + position, anchor, anchorLength) == 0) {
+            return position;
+        }
+
+        position += skip[static_cast<uchar>(character)];
+    }
+
+    return -1;
+}
@@ -0,0 +1,32 @@
+#ifndef SIGNATURESCANNER_H
+#define SIGNATURESCANNER_H
+
+#include <array>
+
+#include <QByteArray>
+
+// Finds a byte signature with wildcards, written as "8B 44 24 ?? E8 ?? ?? ?? ??", in a block of memory.
+// Candidates for the longest run of fixed bytes are found 16 bytes at a time with SSE2 where available and with Boyer-Moore-Horspool otherwise.
+class SignatureScanner
+{
+public:
+    explicit SignatureScanner(const QByteArray &signature);
+
+    bool isValid() const;
+    int length() const;
+    qint64 find(const char *data, qint64 size, qint64 from = 0) const;
+    int count(const char *data, qint64 size, int limit) const;
+    qint64 findUnique(const char *data, qint64 size) const;
+
+private:
+    QByteArray bytes;
+    QByteArray mask; // Non-zero for every fixed byte.
+    int anchorOffset = 0;
+    int anchorLength = 0;
+    std::array<int, 256> skip; // Horspool shift for the anchor.
+
+    bool matches(const char *data) const;
+    qint64 findAnchor(const char *data, qint64 from, qint64 end) const;
+};
+
+#endif // SIGNATURESCANNER_H
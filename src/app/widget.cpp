@@ -7,6 +7,7 @@
 #include <QHostAddress>
 #include <QAbstractSocket>
 #include <QFileDialog>
+#include <QtConcurrent>
 
 #include "widget.h"
 #include "ui_widget.h"
@@ -36,12 +37,23 @@ Widget::Widget(QWidget *parent) :
     // Populate comboBox with detected network interfaces.
     populateComboboxWithNetworkInterfaces();
 
+    // Patching runs on a worker thread and reports back through these.
+    patchProgress = new PatchProgress(this);
+    patchWatcher = new QFutureWatcher<bool>(this);
+
     // Load settings from configuration file.
     settings = new QSettings(app_configuration_file, QSettings::IniFormat, this);
     loadSettings();
 
-    // Update patch button according to patch status.
     QString path = getInstallDirectory(false);
+    QDir dir = path;
+
+    // Finish or roll back a patch that was interrupted last time.
+    if (!path.isEmpty() && dir.cd(game_executable_directory)) {
+        Patcher::recover(dir);
+    }
+
+    // Update patch button according to patch status.
     bool patched = Patcher::isPatched(path);
     updatePatchStatus(patched);
 
@@ -51,6 +63,11 @@ Widget::Widget(QWidget *parent) :
     connect(ui->comboBox_network_interface,     QOverload<int>::of(&QComboBox::currentIndexChanged),    this, &Widget::comboBox_network_interface_currentIndexChanged);
     connect(ui->pushButton_patch,               &QPushButton::clicked,                                  this, &Widget::pushButton_patch_clicked);
 
+    // Register patch progress signals to slots, they arrive queued from the worker threads.
+    connect(patchProgress,                      &PatchProgress::fileStarted,                            this, &Widget::patchProgress_fileStarted);
+    connect(patchProgress,                      &PatchProgress::progressChanged,                        this, &Widget::patchProgress_progressChanged);
+    connect(patchWatcher,                       &QFutureWatcher<bool>::finished,                        this, &Widget::patchWatcher_finished);
+
     // Register signals to saveSettings slot.
     connect(ui->comboBox_install_directory,     QOverload<int>::of(&QComboBox::currentIndexChanged),    this, &Widget::saveSettings);
     connect(ui->comboBox_network_interface,     QOverload<int>::of(&QComboBox::currentIndexChanged),    this, &Widget::saveSettings);
@@ -64,6 +81,18 @@ Widget::~Widget()
 
 void Widget::closeEvent(QCloseEvent *event)
 {
+    // Let a running patch roll back before quitting.
+    if (patchWatcher->isRunning()) {
+        patchWatcher->disconnect(this);
+        patchProgress->cancel();
+        patchWatcher->waitForFinished();
+
+        // Handled here instead of in patchWatcher_finished(), a patch already past its last commit still needs its configuration.
+        if (patchWatcher->result()) {
+            Patcher::generateConfigurationFile(patchDir, ui->comboBox_network_interface->currentData().value<QNetworkInterface>());
+        }
+    }
+
     saveSettings();
 
     QWidget::closeEvent(event);
@@ -91,6 +120,11 @@ void Widget::loadSettings()
         }
     }
 
+    // Verify game files by their patch sites instead of whole file checksums if configured to.
+    if (settings->value(settings_verification_mode).toString() == settings_verification_mode_patch_sites) {
+        FileUtils::setVerificationMode(VerificationMode::PatchSites);
+    }
+
     int index = settings->value(settings_interface_index).toInt();
 
     // Only set valid index in UI.
@@ -221,6 +255,14 @@ void Widget::comboBox_network_interface_currentIndexChanged(int index)
 
 void Widget::pushButton_patch_clicked()
 {
+    // While patching the button cancels instead.
+    if (patchWatcher->isRunning()) {
+        patchProgress->cancel();
+        ui->pushButton_patch->setEnabled(false);
+
+        return;
+    }
+
     // Create path to binary folder.
     QString path = getInstallDirectory();
 
@@ -233,16 +275,67 @@ void Widget::pushButton_patch_clicked()
 
     // Only show option to patch if not already patched.
     if (Patcher::isPatched(dir.absolutePath())) {
-        Patcher::undoPatch(dir);
+        PatchReport undoReport;
+        bool undone = Patcher::undoPatch(dir, &undoReport);
+
+        if (!undone) {
+            QMessageBox::warning(this, "Warning", undoReport.error);
+        }
 
-        updatePatchStatus(false);
+        updatePatchStatus(!undone);
     } else {
-        // Apply patch to files, if successful continue.
-        if (Patcher::patch(this, dir)) {
-            // Generate network configuration.
-            Patcher::generateConfigurationFile(dir, ui->comboBox_network_interface->currentData().value<QNetworkInterface>());
+        patchDir = dir;
+        patchReport = PatchReport();
+        patchProgress->reset();
+        setPatching(true);
+
+        // Apply patch to files in the background, the result is handled in patchWatcher_finished().
+        patchWatcher->setFuture(QtConcurrent::run([this, dir] {
+            return Patcher::patch(dir, &patchReport, patchProgress);
+        }));
+    }
+}
 
-            updatePatchStatus(true);
-        }
+void Widget::setPatching(bool patching) const
+{
+    ui->progressBar_patch->setVisible(patching);
+    ui->progressBar_patch->setValue(0);
+    ui->comboBox_install_directory->setEnabled(!patching);
+    ui->pushButton_install_directory->setEnabled(!patching);
+    ui->comboBox_network_interface->setEnabled(!patching);
+    ui->pushButton_patch->setEnabled(true);
+
+    if (patching) {
+        ui->pushButton_patch->setText(tr("Cancel"));
     }
 }
+
+void Widget::patchProgress_fileStarted(const QString &fileName) const
+{
+    ui->progressBar_patch->setFormat(tr("Patching %1... %p%").arg(fileName));
+}
+
+void Widget::patchProgress_progressChanged(qint64 bytes, qint64 totalBytes) const
+{
+    // Scale down so large byte counts fit the int range of the progress bar.
+    ui->progressBar_patch->setMaximum(1000);
+    ui->progressBar_patch->setValue(totalBytes > 0 ? static_cast<int>(bytes * 1000 / totalBytes) : 0);
+}
+
+void Widget::patchWatcher_finished()
+{
+    bool patched = patchWatcher->result();
+    setPatching(false);
+
+    // If successful continue.
+    if (patched) {
+        // Generate network configuration.
+        Patcher::generateConfigurationFile(patchDir, ui->comboBox_network_interface->currentData().value<QNetworkInterface>());
+    } else if (patchProgress->isCanceled()) {
+        QMessageBox::information(this, "Information", patchReport.error);
+    } else {
+        QMessageBox::warning(this, "Warning", patchReport.error);
+    }
+
+    updatePatchStatus(patched);
+}
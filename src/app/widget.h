@@ -5,8 +5,12 @@
 #include <QSettings>
 #include <QCloseEvent>
 #include <QString>
+#include <QDir>
+#include <QFutureWatcher>
 
 #include "global.h"
+#include "patcher.h"
+#include "patchprogress.h"
 
 namespace Ui {
     class Widget;
@@ -23,6 +27,10 @@ public:
 private:
     Ui::Widget *ui;
     QSettings *settings;
+    PatchProgress *patchProgress;
+    QFutureWatcher<bool> *patchWatcher;
+    PatchReport patchReport;
+    QDir patchDir;
 
     void closeEvent(QCloseEvent *event);
     void loadSettings();
@@ -31,6 +39,7 @@ private:
     void populateComboboxWithInstallDirectories() const;
     void populateComboboxWithNetworkInterfaces() const;
     void updatePatchStatus(bool patched) const;
+    void setPatching(bool patching) const;
 
 private slots:
     void saveSettings() const;
@@ -39,6 +48,9 @@ private slots:
     void pushButton_install_directory_clicked();
     void comboBox_network_interface_currentIndexChanged(int index);
     void pushButton_patch_clicked();
+    void patchProgress_fileStarted(const QString &fileName) const;
+    void patchProgress_progressChanged(qint64 bytes, qint64 totalBytes) const;
+    void patchWatcher_finished();
 };
 
 #endif // WIDGET_H
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include <cmath>
+
+#include <QtGlobal>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "benchmark.h"
+
+constexpr double nanoseconds_per_millisecond = 1000000.0;
+constexpr double bytes_per_megabyte = 1024.0 * 1024.0;
+
+void Benchmark::addSample(const QString &phase, qint64 nanoseconds, qint64 bytes)
+{
+    // Keep phases in the order they were first measured.
+    if (!phases.contains(phase)) {
+        phaseNames.append(phase);
+    }
+
+    Phase &entry = phases[phase];
+    entry.samples.append(nanoseconds);
+    entry.bytes = bytes;
+}
+
+QJsonObject Benchmark::toJson() const
+{
+    QJsonObject result;
+
+    for (const QString &name : phaseNames) {
+        const Phase &phase = phases[name];
+        QList<qint64> samples = phase.samples;
+        std::sort(samples.begin(), samples.end());
+
+        qint64 total = 0;
+
+        for (qint64 sample : samples) {
+            total += sample;
+        }
+
+        double median = percentile(samples, 50);
+        QJsonObject object;
+        object.insert("samples", samples.length());
+        object.insert("minMs", samples.first() / nanoseconds_per_millisecond);
+        object.insert("p50Ms", median / nanoseconds_per_millisecond);
+        object.insert("p90Ms", percentile(samples, 90) / nanoseconds_per_millisecond);
+        object.insert("p99Ms", percentile(samples, 99) / nanoseconds_per_millisecond);
+        object.insert("maxMs", samples.last() / nanoseconds_per_millisecond);
+        object.insert("meanMs", total / static_cast<double>(samples.length()) / nanoseconds_per_millisecond);
+
+        // Throughput only makes sense for phases that process the whole file.
+        if (phase.bytes > 0 && median > 0) {
+            object.insert("bytes", phase.bytes);
+            object.insert("throughputMBps", phase.bytes / bytes_per_megabyte / (median / (nanoseconds_per_millisecond * 1000)));
+        }
+
+        result.insert(name, object);
+    }
+
+    return result;
+}
+
+qint64 Benchmark::getPeakResidentSetSize()
+{
+#ifdef Q_OS_WIN
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+
+    return 0;
+#else
+    rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+
+#ifdef Q_OS_MACOS
+    return usage.ru_maxrss;
+#else
+    // Reported in kilobytes on Linux.
+    return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+double Benchmark::percentile(const QList<qint64> &sortedSamples, double percent)
+{
+    if (sortedSamples.isEmpty()) {
+        return 0;
+    }
+
+    // Nearest-rank method.
+    int rank = static_cast<int>(std::ceil(percent / 100 * sortedSamples.length()));
+
+    return sortedSamples[qBound(1, rank, sortedSamples.length()) - 1];
+}
@@ -0,0 +1,30 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QJsonObject>
+
+class Benchmark
+{
+public:
+    void addSample(const QString &phase, qint64 nanoseconds, qint64 bytes = 0);
+    QJsonObject toJson() const;
+
+    static qint64 getPeakResidentSetSize();
+
+private:
+    struct Phase {
+        QList<qint64> samples;
+        qint64 bytes = 0;
+    };
+
+    QStringList phaseNames;
+    QHash<QString, Phase> phases;
+
+    static double percentile(const QList<qint64> &sortedSamples, double percent);
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,176 @@
+#include <limits>
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QFile>
+#include <QDir>
+
+#include "global.h"
+#include "patchdatabase.h"
+#include "fileutils.h"
+#include "patcher.h"
+#include "pefile.h"
+#include "signaturescanner.h"
+#include "benchmark.h"
+#include "fixturegenerator.h"
+
+constexpr qint64 bench_default_size = 20 * 1024 * 1024; // Roughly the size of Dunia.dll.
+constexpr int bench_default_iterations = 10;
+
+static bool verbose = false;
+
+static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    Q_UNUSED(context)
+
+    // The patch pipeline logs every patched address, which would drown the measurements.
+    if (type == QtDebugMsg && !verbose) {
+        return;
+    }
+
+    QTextStream(stderr) << message << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName(app_organization);
+    app.setApplicationName(QString("%1 Benchmark").arg(app_name));
+    app.setApplicationVersion(APP_VERSION);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures the patch pipeline on synthetic PE images.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption({ "size", "Size of each synthetic image in bytes.", "bytes", QString::number(bench_default_size) });
+    parser.addOption({ "iterations", "Number of samples per phase.", "count", QString::number(bench_default_iterations) });
+    parser.addOption({ "output", "Write results to file instead of stdout.", "file" });
+    parser.addOption({ "verbose", "Show debug output of the patch pipeline." });
+    parser.process(app);
+
+    verbose = parser.isSet("verbose");
+    qInstallMessageHandler(messageHandler);
+
+    qint64 size = parser.value("size").toLongLong();
+    int iterations = qMax(1, parser.value("iterations").toInt());
+
+    QTemporaryDir temporaryDir;
+
+    if (!temporaryDir.isValid()) {
+        qWarning().noquote() << "Error: Could not create temporary directory.";
+
+        return 1;
+    }
+
+    QDir dir = temporaryDir.path();
+    dir.mkdir(game_executable_directory);
+    dir.cd(game_executable_directory);
+
+    // Every phase has to do the real work, not hit the checksum cache.
+    FileUtils::setCheckSumCacheEnabled(false);
+
+    Benchmark benchmark;
+
+    for (const FileEntry &fileEntry : PatchDatabase::getFiles()) {
+        const TargetEntry &target = fileEntry.getTargets().first();
+        QString name = fileEntry.getName();
+        QString fileName = dir.filePath(name);
+        QString workFileName = dir.filePath(name + ".work");
+
+        if (!FixtureGenerator::generate(fileName, fileEntry, target, size)) {
+            qWarning().noquote() << QString("Error: Could not generate synthetic image for %1.").arg(name);
+
+            return 1;
+        }
+
+        qint64 bytes = QFileInfo(fileName).size();
+        QElapsedTimer timer;
+
+        // Scanning works on memory, so keep the disk out of it.
+        QFile imageFile(fileName);
+        imageFile.open(QFile::ReadOnly);
+        QByteArray image = imageFile.readAll();
+        imageFile.close();
+        SignatureScanner scanner("FF 15 ?? ?? ?? ??"); // call dword ptr [imm32], as at every imported call site.
+
+        for (int i = 0; i < iterations; i++) {
+            timer.start();
+            FileUtils::checkSum(fileName);
+            benchmark.addSample(name + "/checkSum", timer.nsecsElapsed(), bytes);
+
+            timer.start();
+            scanner.count(image.constData(), image.size(), std::numeric_limits<int>::max());
+            benchmark.addSample(name + "/scan", timer.nsecsElapsed(), bytes);
+
+            // Writing replaces the file in place, so work on a fresh copy every time.
+            QFile::remove(workFileName);
+            QFile::copy(fileName, workFileName);
+            QFile workFile(workFileName);
+
+            timer.start();
+            PeFile peFile(workFile);
+            benchmark.addSample(name + "/read", timer.nsecsElapsed(), bytes);
+
+            timer.start();
+            peFile.apply(patch_library_pe_import_section, patch_library_file, patch_library_functions, target.getCodeEntries());
+            benchmark.addSample(name + "/apply", timer.nsecsElapsed());
+
+            // Patching is idempotent, so run it again on its own to time it separately from apply.
+            timer.start();
+            peFile.patchCode(patch_library_file, patch_library_functions, target.getCodeEntries());
+            benchmark.addSample(name + "/patchCode", timer.nsecsElapsed());
+
+            timer.start();
+            peFile.write();
+            benchmark.addSample(name + "/write", timer.nsecsElapsed(), QFileInfo(workFileName).size());
+
+            // Appending needs the unpatched file on disk again.
+            QFile::remove(workFileName);
+            QFile::copy(fileName, workFileName);
+
+            timer.start();
+            peFile.write(nullptr, PeFile::WRITE_APPEND);
+            benchmark.addSample(name + "/writeAppend", timer.nsecsElapsed());
+        }
+
+        QFile::remove(workFileName);
+    }
+
+    QElapsedTimer timer;
+
+    for (int i = 0; i < iterations; i++) {
+        timer.start();
+        Patcher::isPatched(dir.absolutePath());
+        benchmark.addSample("isPatched", timer.nsecsElapsed());
+    }
+
+    QJsonObject result;
+    result.insert("version", APP_VERSION);
+    result.insert("imageSize", size);
+    result.insert("iterations", iterations);
+    result.insert("phases", benchmark.toJson());
+    result.insert("peakRssBytes", Benchmark::getPeakResidentSetSize());
+
+    QByteArray json = QJsonDocument(result).toJson();
+
+    if (parser.isSet("output")) {
+        QFile outputFile(parser.value("output"));
+
+        if (!outputFile.open(QFile::WriteOnly | QFile::Truncate)) {
+            qWarning().noquote() << QString("Error: Cannot create: %1").arg(outputFile.fileName());
+
+            return 1;
+        }
+
+        outputFile.write(json);
+    } else {
+        QTextStream(stdout) << json;
+    }
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+QT += network concurrent widgets
+
+TARGET = fc2mppatcher-check
+TEMPLATE = app
+CONFIG += \
+        c++17 \
+        console \
+        static
+CONFIG -= app_bundle
+
+# Runs the round trip on "make check".
+CONFIG += testcase
+
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+# Signature scanning compares 16 bytes at a time, 32-bit x86 targets do not enable SSE2 by default.
+QMAKE_CXXFLAGS += $$QMAKE_CFLAGS_SSE2
+
+# Checked code is built straight from the application sources.
+INCLUDEPATH += $$PWD/../app
+DEPENDPATH += $$PWD/../app
+
+HEADERS += \
+    ../app/addressindex.h \
+    ../app/delta.h \
+    ../app/fileutils.h \
+    ../app/hashstreambuffer.h \
+    ../app/importindex.h \
+    ../app/memorystreambuffer.h \
+    ../app/outputcache.h \
+    ../app/patcher.h \
+    ../app/patchplan.h \
+    ../app/patchprogress.h \
+    ../app/pefile.h \
+    ../app/peheader.h \
+    ../app/signaturescanner.h
+
+SOURCES += \
+    ../app/addressindex.cpp \
+    ../app/delta.cpp \
+    ../app/fileutils.cpp \
+    ../app/hashstreambuffer.cpp \
+    ../app/importindex.cpp \
+    ../app/memorystreambuffer.cpp \
+    ../app/outputcache.cpp \
+    ../app/patcher.cpp \
+    ../app/patchplan.cpp \
+    ../app/patchprogress.cpp \
+    ../app/pefile.cpp \
+    ../app/peheader.cpp \
+    ../app/signaturescanner.cpp \
+    main.cpp
+
+include(../fixture/fixture.pri)
+include(../common/common.pri)
+
+# Including 3rd party PeBliss library.
+INCLUDEPATH += $$PWD/../../lib/libpebliss/pe_lib
+DEPENDPATH += $$PWD/../../lib/libpebliss/pe_lib
+
+LIBS += -L$$PWD/../../lib/libpebliss/lib -lpebliss
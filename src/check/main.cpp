@@ -0,0 +1,134 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTemporaryDir>
+#include <QTextStream>
+#include <QDebug>
+#include <QFile>
+#include <QDir>
+
+#include "global.h"
+#include "patchdatabase.h"
+#include "fileutils.h"
+#include "patcher.h"
+#include "fixturegenerator.h"
+
+static bool checkEdition(const QDir &dir, int edition, qint64 size)
+{
+    if (!FixtureGenerator::generateInstall(dir, edition, size)) {
+        qWarning().noquote() << QString("Error: Could not generate edition %1.").arg(edition);
+
+        return false;
+    }
+
+    QDir binDir = dir;
+    binDir.cd(game_executable_directory);
+
+    const QList<FileEntry> &files = PatchDatabase::getFiles();
+    QList<CheckSum> checkSums;
+
+    for (const FileEntry &fileEntry : files) {
+        checkSums.append(FileUtils::checkSum(binDir.filePath(fileEntry.getName())));
+    }
+
+    PatchReport report;
+
+    if (!Patcher::patch(binDir, &report)) {
+        qWarning().noquote() << QString("Error: Edition %1 could not be patched: %2").arg(edition).arg(report.error);
+
+        return false;
+    }
+
+    // Verified again here, in debug mode the patcher keeps files that do not verify.
+    for (int i = 0; i < files.length(); i++) {
+        const TargetEntry &target = files[i].getTargets()[edition];
+
+        if (i >= report.files.length() || report.files[i].status != FileReport::PATCHED || report.files[i].target != target.getName() || !FileUtils::isValid(binDir, files[i], target, true)) {
+            qWarning().noquote() << QString("Error: Edition %1 did not patch %2 as %3.").arg(edition).arg(files[i].getName()).arg(target.getName());
+
+            return false;
+        }
+    }
+
+    if (!Patcher::isPatched(binDir.absolutePath())) {
+        qWarning().noquote() << QString("Error: Edition %1 is not recognized as patched.").arg(edition);
+
+        return false;
+    }
+
+    PatchReport undoReport;
+
+    if (!Patcher::undoPatch(binDir, &undoReport)) {
+        qWarning().noquote() << QString("Error: Edition %1 could not be restored: %2").arg(edition).arg(undoReport.error);
+
+        return false;
+    }
+
+    // Undoing has to leave the exact files that were there before patching.
+    for (int i = 0; i < files.length(); i++) {
+        QString fileName = files[i].getName();
+
+        if (i >= undoReport.files.length() || undoReport.files[i].status != FileReport::RESTORED || FileUtils::checkSum(binDir.filePath(fileName)) != checkSums[i]) {
+            qWarning().noquote() << QString("Error: Edition %1 did not restore the original %2.").arg(edition).arg(fileName);
+
+            return false;
+        }
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName(app_organization);
+    app.setApplicationName(QString("%1 Check").arg(app_name));
+    app.setApplicationVersion(APP_VERSION);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Patches, verifies and undoes a synthetic install of every edition in the patch table.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addOption({ "edition", "Only check the edition with this index in the patch table.", "index" });
+    parser.addOption({ "size", "Minimum size of each image in bytes.", "bytes", "0" });
+    parser.process(app);
+
+    QTemporaryDir temporaryDir;
+
+    if (!temporaryDir.isValid()) {
+        qWarning().noquote() << "Error: Could not create temporary directory.";
+
+        return 1;
+    }
+
+    // Synthetic images only carry the original bytes at the patch sites, their checksums are not in the tables.
+    FileUtils::setVerificationMode(VerificationMode::PatchSites);
+    FileUtils::setCheckSumCacheEnabled(false);
+
+    QDir dir = temporaryDir.path();
+    qint64 size = parser.value("size").toLongLong();
+    int editions = 0;
+    int failed = 0;
+
+    for (const FileEntry &fileEntry : PatchDatabase::getFiles()) {
+        editions = qMax(editions, fileEntry.getTargets().length());
+    }
+
+    for (int i = 0; i < editions; i++) {
+        if (parser.isSet("edition") && parser.value("edition").toInt() != i) {
+            continue;
+        }
+
+        QDir installDir = dir;
+
+        if (!installDir.mkpath(QString::number(i)) || !installDir.cd(QString::number(i)) || !checkEdition(installDir, i, size)) {
+            QTextStream(stdout) << QString("Edition %1: failed").arg(i) << '\n';
+            failed++;
+
+            continue;
+        }
+
+        QTextStream(stdout) << QString("Edition %1: passed").arg(i) << '\n';
+    }
+
+    return failed > 0 ? 1 : 0;
+}
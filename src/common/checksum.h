@@ -0,0 +1,47 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+// SHA-256 digest in binary form.
+using CheckSum = std::array<uint8_t, 32>;
+
+constexpr uint8_t checkSumHexValue(char character)
+{
+    return character >= '0' && character <= '9' ? static_cast<uint8_t>(character - '0') :
+           character >= 'a' && character <= 'f' ? static_cast<uint8_t>(character - 'a' + 10) :
+           character >= 'A' && character <= 'F' ? static_cast<uint8_t>(character - 'A' + 10) :
+           throw std::invalid_argument("Invalid hex digit in checksum.");
+}
+
+// Parses a hex checksum literal, malformed literals fail to compile when used in a constant expression.
+constexpr CheckSum operator""_sha256(const char *hex, std::size_t length)
+{
+    if (length != std::tuple_size<CheckSum>::value * 2) {
+        throw std::invalid_argument("Checksum must be 64 hex digits.");
+    }
+
+    CheckSum checkSum {};
+
+    for (std::size_t i = 0; i < checkSum.size(); i++) {
+        checkSum[i] = static_cast<uint8_t>(checkSumHexValue(hex[i * 2]) << 4 | checkSumHexValue(hex[i * 2 + 1]));
+    }
+
+    return checkSum;
+}
+
+// Digests are uniformly distributed already, so the leading bytes make a good hash.
+struct CheckSumHash {
+    std::size_t operator()(const CheckSum &checkSum) const noexcept {
+        std::size_t hash;
+        std::memcpy(&hash, checkSum.data(), sizeof(hash));
+
+        return hash;
+    }
+};
+
+#endif // CHECKSUM_H
@@ -5,5 +5,11 @@ INCLUDEPATH += $$PWD
 DEPENDPATH += $$PWD
 
 HEADERS += \
+    $$PWD/checksum.h \
     $$PWD/entry.h \
-    $$PWD/global.h
+    $$PWD/global.h \
+    $$PWD/patchdatabase.h \
+    $$PWD/patchtable.h
+
+SOURCES += \
+    $$PWD/patchdatabase.cpp
@@ -4,6 +4,8 @@
 #include <QList>
 #include <QByteArray>
 
+#include "checksum.h"
+
 class CodeEntry {
 public:
     enum Type {
@@ -12,12 +14,15 @@ public:
         NEW_DATA
     };
 
-    CodeEntry(uint32_t address, uint32_t word, const QString &section = ".text", Type type = INJECT_SYMBOL) :
-        CodeEntry(address, QByteArray::number(word), section, type) {}
+    CodeEntry(uint32_t address, uint32_t word, const QString &section = ".text", Type type = INJECT_SYMBOL, const QByteArray &signature = QByteArray(), int signatureOffset = 0) :
+        CodeEntry(address, QByteArray::number(word), section, type, QByteArray(), signature, signatureOffset) {}
 
-    CodeEntry(uint32_t address, const QByteArray &data, const QString &section = ".text", Type type = INJECT_DATA) :
+    CodeEntry(uint32_t address, const QByteArray &data, const QString &section = ".text", Type type = INJECT_DATA, const QByteArray &originalData = QByteArray(), const QByteArray &signature = QByteArray(), int signatureOffset = 0) :
         address(address),
         data(data),
+        originalData(originalData),
+        signature(signature),
+        signatureOffset(signatureOffset),
         section(section),
         type(type) {}
 
@@ -30,11 +35,31 @@ public:
         return address;
     }
 
-    QByteArray getData() const {
+    // Used once a signature located this entry.
+    void setAddress(uint32_t value) {
+        address = value;
+    }
+
+    const QByteArray &getData() const {
         return data;
     }
 
-    QString getSection() const {
+    // Bytes expected at this address before patching, empty if not known.
+    const QByteArray &getOriginalData() const {
+        return originalData;
+    }
+
+    // Byte pattern locating this address in its section, like "85 C0 74 ?? 8B 4D", empty if the address is fixed.
+    const QByteArray &getSignature() const {
+        return signature;
+    }
+
+    // Distance from the start of a signature match to the address.
+    int getSignatureOffset() const {
+        return signatureOffset;
+    }
+
+    const QString &getSection() const {
         return section;
     }
 
@@ -45,32 +70,96 @@ public:
 private:
     uint32_t address = 0;
     QByteArray data;
+    QByteArray originalData;
+    QByteArray signature;
+    int signatureOffset = 0;
     QString section;
     Type type;
 };
 
+class PeFingerprint {
+public:
+    PeFingerprint() = default;
+
+    PeFingerprint(qint64 fileSize, uint32_t timeDateStamp, uint32_t sizeOfImage, uint16_t numberOfSections, uint32_t sectionTableHash) :
+        fileSize(fileSize),
+        timeDateStamp(timeDateStamp),
+        sizeOfImage(sizeOfImage),
+        numberOfSections(numberOfSections),
+        sectionTableHash(sectionTableHash) {}
+
+    bool isEmpty() const {
+        return fileSize == 0;
+    }
+
+    qint64 getFileSize() const {
+        return fileSize;
+    }
+
+    uint32_t getTimeDateStamp() const {
+        return timeDateStamp;
+    }
+
+    uint32_t getSizeOfImage() const {
+        return sizeOfImage;
+    }
+
+    uint16_t getNumberOfSections() const {
+        return numberOfSections;
+    }
+
+    uint32_t getSectionTableHash() const {
+        return sectionTableHash;
+    }
+
+    bool operator==(const PeFingerprint &other) const {
+        return fileSize == other.fileSize &&
+               timeDateStamp == other.timeDateStamp &&
+               sizeOfImage == other.sizeOfImage &&
+               numberOfSections == other.numberOfSections &&
+               sectionTableHash == other.sectionTableHash;
+    }
+
+    bool operator!=(const PeFingerprint &other) const {
+        return !(*this == other);
+    }
+
+private:
+    qint64 fileSize = 0;
+    uint32_t timeDateStamp = 0;
+    uint32_t sizeOfImage = 0;
+    uint16_t numberOfSections = 0;
+    uint32_t sectionTableHash = 0;
+};
+
 class TargetEntry {
 public:
-    TargetEntry(const char *checkSum, const char *checkSumPatched, const QList<CodeEntry> &functions) :
+    TargetEntry(const char *name, const CheckSum &checkSum, const CheckSum &checkSumPatched, const QList<CodeEntry> &functions) :
+        name(name),
         checkSum(checkSum),
         checkSumPatched(checkSumPatched),
         addresses(functions) {}
 
-    const char *getCheckSum() const {
+    const char *getName() const {
+        return name;
+    }
+
+    const CheckSum &getCheckSum() const {
         return checkSum;
     }
 
-    const char *getCheckSumPatched() const {
+    const CheckSum &getCheckSumPatched() const {
         return checkSumPatched;
     }
 
-    QList<CodeEntry> getCodeEntries() const {
+    const QList<CodeEntry> &getCodeEntries() const {
         return addresses;
     }
 
 private:
-    const char* checkSum;
-    const char* checkSumPatched;
+    const char *name;
+    CheckSum checkSum;
+    CheckSum checkSumPatched;
     QList<CodeEntry> addresses;
 };
 
@@ -84,7 +173,7 @@ public:
         return name;
     }
 
-    QList<TargetEntry> getTargets() const {
+    const QList<TargetEntry> &getTargets() const {
         return targets;
     }
 
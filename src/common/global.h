@@ -1,12 +1,17 @@
 #ifndef GLOBAL_H
 #define GLOBAL_H
 
+#include <array>
+#include <string_view>
+
 #include <QString>
 #include <QStringList>
 #include <QByteArray>
 #include <QList>
+#include <QPair>
 
 #include "entry.h"
+#include "patchtable.h"
 
 // Set true for debugging mode without checksum verification.
 #define DEBUG_MODE true
@@ -14,9 +19,24 @@
 constexpr char app_name[] = "FC2MPPatcher";
 const QString app_organization = app_name;
 const QString app_configuration_file = QString(app_name).toLower() + ".ini";
+const QString app_checksum_cache_file = QString(app_name).toLower() + "_checksums.ini";
+const QString app_patch_plan_directory = QString(app_name).toLower() + "_plans";
+constexpr char app_patch_plan_suffix[] = ".plan";
+const QString app_delta_directory = "deltas";
+constexpr char app_delta_suffix[] = ".delta";
+const QString app_output_cache_directory = QString(app_name).toLower() + "_outputs";
+const QString app_patch_database_file = QString(app_name).toLower() + ".db";
+
+constexpr char checksum_cache_path[] = "path";
+constexpr char checksum_cache_size[] = "size";
+constexpr char checksum_cache_modified[] = "modified";
+constexpr char checksum_cache_file_id[] = "fileId";
+constexpr char checksum_cache_checksum[] = "checkSum";
 
 constexpr char settings_install_directory[] = "installDirectory";
 constexpr char settings_interface_index[] = "interfaceIndex";
+constexpr char settings_verification_mode[] = "verificationMode";
+constexpr char settings_verification_mode_patch_sites[] = "patchSites";
 constexpr char settings_group_window[] = "Window";
 constexpr char settings_group_window_size[] = "size";
 constexpr char settings_group_window_position[] = "position";
@@ -26,6 +46,7 @@ constexpr char game_name[] = "Far Cry 2";
 constexpr char game_publisher[] = "Ubisoft";
 constexpr char game_executable_directory[] = "bin";
 constexpr char game_backup_suffix[] = "_original";
+constexpr char game_temporary_suffix[] = "_patching";
 
 constexpr char game_steam_name[] = "Steam";
 constexpr char game_steam_publisher[] = "Valve";
@@ -41,7 +62,7 @@ constexpr char patch_library_name[] = "MPPatch";
 const QString patch_library_file = QString(patch_library_name).toLower() + ".dll";
 const QString patch_library_pe_import_section = QString(patch_library_name).toLower();
 constexpr char patch_library_pe_text_section[] = ".text_mp";
-const QStringList patch_library_functions = {
+constexpr std::array<const char*, 6> patch_library_function_names = {
     "_ZN7MPPatch10bind_patchEjPK8sockaddri@12",                   // bind()
     "_ZN7MPPatch13connect_patchEjPK8sockaddri@12",                // connect()
     "_ZN7MPPatch12sendTo_patchEjPKciiPK8sockaddri@24",            // sendTo()
@@ -49,7 +70,29 @@ const QStringList patch_library_functions = {
     "_ZN7MPPatch19getHostByName_patchEPKc@4",                     // getHostByName()
     "_ZN7MPPatch18getPublicIPAddressEv@0"                         // getPublicIpAddress()
 };
+const QStringList patch_library_functions = [] {
+    QStringList functions;
+
+    for (const char *function : patch_library_function_names) {
+        functions.append(function);
+    }
+
+    return functions;
+}();
+// Functions replaced by patch_library_functions, in the same order.
+const QList<QPair<QString, QString>> patch_library_original_functions = {
+    { "ws2_32.dll", "bind" },
+    { "ws2_32.dll", "connect" },
+    { "ws2_32.dll", "sendto" },
+    { "iphlpapi.dll", "GetAdaptersInfo" },
+    { "ws2_32.dll", "gethostbyname" }
+};
+// Bump whenever the patch tables or the way files are patched change, it invalidates cached patched files.
+constexpr int patch_table_version = 1;
 const QString patch_configuration_file = QString(patch_library_name).toLower() + ".cfg";
+const QString patch_journal_file = QString(patch_library_name).toLower() + "_journal.ini";
+constexpr char patch_journal_state_writing[] = "writing";
+constexpr char patch_journal_state_committing[] = "committing";
 constexpr char patch_configuration_network[] = "Network";
 constexpr char patch_configuration_network_interface_index[] = "InterfaceIndex";
 const QStringList patch_library_runtime_dependencies = {
@@ -66,139 +109,171 @@ constexpr char patch_network_lobbyserver_address[] = "216.98.48.56";
 constexpr unsigned short patch_network_lobbyserver_port = 3035;
 
 // Currently only applies to Steam and Uplay editions, changes game id sent to Ubisoft to that of the Retail edition.
-const QByteArray patch_game_id = QString("2c66b725e7fb0697c0595397a14b0bc8").toUtf8();
-
-const QList<FileEntry> files = {
-    {
-        "Dunia.dll",
-        {
-            { // Retail (GOG is identical)
-                "7b82f20088e5c046a99fcaed65dc8bbb8202fd622a69737be83e00686b172d53",
-                "020ba8709ba7090fa9e29c77f26a66ea230aef92677fe93560d97e391be43c97",
-                {
-                    // Common
-                    { 0x1001088e, 0 }, // bind()
-                    { 0x10213d18, 0 }, // bind()
-                    { 0x10c4e97a, 0 }, // bind()
-                    { 0x10cb9a8c, 0 }, // bind()
-                    { 0x10cb9ad4, 0 }, // bind()
-                    { 0x10014053, 2 }, // sendTo()
-                    { 0x10c5bde2, 3 }, // getAdapersInfo()
-                    { 0x1001431c, 4 }  // getHostByName()
-                }
-            },
-            { // Steam
-                "6353936a54aa841350bb30ff005727859cdef1aa10c209209b220b399e862765",
-                "40f4d55fe0ac6b370798983de2ca1dd09ef0423a7c523b7c424cadddbd894a25",
-                {
-                    // Common
-                    { 0x1001076e, 0 }, // bind()
-                    { 0x102161a8, 0 }, // bind()
-                    { 0x10c5d10a, 0 }, // bind()
-                    { 0x10cf289c, 0 }, // bind()
-                    { 0x10cf28e4, 0 }, // bind()
-                    { 0x10013f33, 2 }, // sendTo()
-                    { 0x10c6a692, 3 }, // getAdapersInfo()
-                    { 0x100141fc, 4 }, // getHostByName()
-
-                    // Client
-                    { 0x10e420c0, patch_game_id, ".rdata" } // game_id
-                }
-            },
-            { // Uplay
-                "b7219dcd53317b958c8a31c9241f6855cab660a122ce69a0d88cf4c356944e92",
-                "c7674c14bad4214e547da3d60ccb14225665394f75b941b10c33362b206575c5",
-                {
-                    // Common
-                    { 0x1001076e, 0 }, // bind()
-                    { 0x102161a8, 0 }, // bind()
-                    { 0x10c5d10a, 0 }, // bind()
-                    { 0x10cf289c, 0 }, // bind()
-                    { 0x10cf28e4, 0 }, // bind()
-                    { 0x10013f33, 2 }, // sendTo()
-                    { 0x10c6a692, 3 }, // getAdapersInfo()
-                    { 0x100141fc, 4 }, // getHostByName()
-
-                    // Client
-                    { 0x10e420c0, patch_game_id, ".rdata" } // game_id
-                }
-            }
-        }
+constexpr std::string_view patch_game_id = "2c66b725e7fb0697c0595397a14b0bc8";
+
+// Compiled-in patch tables, checked at compile time, use PatchDatabase::getFiles() to get the tables in effect.
+constexpr PatchCode patch_table_dunia_retail[] = {
+    // Common
+    { 0x1001088e, 0 }, // bind()
+    { 0x10213d18, 0 }, // bind()
+    { 0x10c4e97a, 0 }, // bind()
+    { 0x10cb9a8c, 0 }, // bind()
+    { 0x10cb9ad4, 0 }, // bind()
+    { 0x10014053, 2 }, // sendTo()
+    { 0x10c5bde2, 3 }, // getAdapersInfo()
+    { 0x1001431c, 4 }  // getHostByName()
+};
+constexpr PatchCode patch_table_dunia_steam[] = {
+    // Common
+    { 0x1001076e, 0 }, // bind()
+    { 0x102161a8, 0 }, // bind()
+    { 0x10c5d10a, 0 }, // bind()
+    { 0x10cf289c, 0 }, // bind()
+    { 0x10cf28e4, 0 }, // bind()
+    { 0x10013f33, 2 }, // sendTo()
+    { 0x10c6a692, 3 }, // getAdapersInfo()
+    { 0x100141fc, 4 }, // getHostByName()
+
+    // Client
+    { 0x10e420c0, patch_game_id, ".rdata" } // game_id
+};
+constexpr PatchCode patch_table_dunia_uplay[] = {
+    // Common
+    { 0x1001076e, 0 }, // bind()
+    { 0x102161a8, 0 }, // bind()
+    { 0x10c5d10a, 0 }, // bind()
+    { 0x10cf289c, 0 }, // bind()
+    { 0x10cf28e4, 0 }, // bind()
+    { 0x10013f33, 2 }, // sendTo()
+    { 0x10c6a692, 3 }, // getAdapersInfo()
+    { 0x100141fc, 4 }, // getHostByName()
+
+    // Client
+    { 0x10e420c0, patch_game_id, ".rdata" } // game_id
+};
+constexpr PatchTarget patch_table_dunia[] = {
+    { // Retail (GOG is identical)
+        "Retail",
+        "7b82f20088e5c046a99fcaed65dc8bbb8202fd622a69737be83e00686b172d53"_sha256,
+        "020ba8709ba7090fa9e29c77f26a66ea230aef92677fe93560d97e391be43c97"_sha256,
+        patch_table_dunia_retail
     },
-    {
-        "FC2ServerLauncher.exe",
-        {
-            { // Retail (GOG is identical)
-                "c175d2a1918d3e6d4120a2f6e6254bd04907a5ec10d3c1dfac28100d6fbf9ace",
-                "bfb73dffcac987a511be8a7d34f66644e9171dc0fee6a48a17256d6b5e55dc64",
-                {
-                    // Common
-                    { 0x00425fc4, 0 }, // bind()
-                    { 0x0042600b, 0 }, // bind()
-                    { 0x004c9d2a, 0 }, // bind()
-                    { 0x00ba126e, 0 }, // bind()
-                    { 0x00e83eda, 0 }, // bind()
-                    { 0x00ba4a33, 2 }, // sendTo()
-                    { 0x00c444a6, 3 }, // getAdapersInfo()
-                    { 0x00ba4cfc, 4 }, // getHostByName()
-
-                    // Server
-                    { 0x00c43ffd, 1 },  // connect()
-                    { 0x004ecda5, QByteArray("\xEB", 1) } // change JZ (74) to JMP (EB)
-                }
-            },
-            { // Steam (R2 is identical)
-                "5cd5d7b6e6e0b1d25843fdee3e9a743ed10030e89ee109b121109f4a146a062e",
-                "bfb73dffcac987a511be8a7d34f66644e9171dc0fee6a48a17256d6b5e55dc64",
-                {
-                    // Common
-                    { 0x004263d4, 0 }, // bind()
-                    { 0x0042641b, 0 }, // bind()
-                    { 0x004c9d2a, 0 }, // bind()
-                    { 0x00ba36be, 0 }, // bind()
-                    { 0x00e85ffa, 0 }, // bind()
-                    { 0x00ba6e83, 2 }, // sendTo()
-                    { 0x00c46a66, 3 }, // getAdapersInfo()
-                    { 0x00ba714c, 4 }, // getHostByName()
-
-                    // Server
-                    { 0x00c465bd, 1 }, // connect()
-                    { 0x004eca95, QByteArray("\xEB", 1) }, // change JZ (74) to JMP (EB)
-                    { 0x00ab3100, QByteArray("\xE9\xFB\xEE\xCF\x00", 5) }, // change function call to instead jump to the .text_mp section.
-                    { QByteArray("\xE8\x4B\xCB\x2F\xFF"      // call   0xff2fcb50
-                                 "\x51"                      // push   ecx
-                                 "\x50"                      // push   eax
-                                 "\xFF\x15\xA4\x0D\x7B\x01"  // call   DWORD PTR ds:0x17b0da4
-                                 "\x8B\xC8"                  // mov    ecx,eax
-                                 "\x58"                      // pop    eax
-                                 "\x89\x48\x08"              // mov    DWORD PTR [eax+0x8],ecx
-                                 "\x59"                      // pop    ecx
-                                 "\xE9\xEC\x10\x30\xFF", 25) // jmp    0xff301105
-                    }
-                }
-            },
-            { // Uplay
-                "948a8626276a6689c0125f2355b6a820c104f20dee36977973b39964a82f2703",
-                "38f33dfd74b9483fb7db7703dffe61d61fa51444730d38ed2b61fc6e20855d9a",
-                {
-                    // Common
-                    { 0x004263d4, 0 }, // bind()
-                    { 0x0042641b, 0 }, // bind()
-                    { 0x004c9d2a, 0 }, // bind()
-                    { 0x00ba36be, 0 }, // bind()
-                    { 0x00e85ffa, 0 }, // bind()
-                    { 0x00ba6e83, 2 }, // sendTo()
-                    { 0x00c46a66, 3 }, // getAdapersInfo()
-                    { 0x00ba714c, 4 }, // getHostByName()
-
-                    // Server
-                    { 0x00c465bd, 1 },  // connect()
-                    { 0x004eca95, QByteArray("\xEB", 1) }, // change JZ (74) to JMP (EB)
-                    { 0x00ab3100, QByteArray("\xE9\xFB\xEE\xCF\x00", 5) } // change function call to instead jump to .text_mp section.
-                }
-            }
-        }
+    { // Steam
+        "Steam",
+        "6353936a54aa841350bb30ff005727859cdef1aa10c209209b220b399e862765"_sha256,
+        "40f4d55fe0ac6b370798983de2ca1dd09ef0423a7c523b7c424cadddbd894a25"_sha256,
+        patch_table_dunia_steam
+    },
+    { // Uplay
+        "Uplay",
+        "b7219dcd53317b958c8a31c9241f6855cab660a122ce69a0d88cf4c356944e92"_sha256,
+        "c7674c14bad4214e547da3d60ccb14225665394f75b941b10c33362b206575c5"_sha256,
+        patch_table_dunia_uplay
     }
 };
 
+constexpr PatchCode patch_table_server_retail[] = {
+    // Common
+    { 0x00425fc4, 0 }, // bind()
+    { 0x0042600b, 0 }, // bind()
+    { 0x004c9d2a, 0 }, // bind()
+    { 0x00ba126e, 0 }, // bind()
+    { 0x00e83eda, 0 }, // bind()
+    { 0x00ba4a33, 2 }, // sendTo()
+    { 0x00c444a6, 3 }, // getAdapersInfo()
+    { 0x00ba4cfc, 4 }, // getHostByName()
+
+    // Server
+    { 0x00c43ffd, 1 },  // connect()
+    { 0x004ecda5, std::string_view("\xEB", 1), ".text", CodeEntry::INJECT_DATA, std::string_view("\x74", 1) } // change JZ (74) to JMP (EB)
+};
+constexpr PatchCode patch_table_server_steam[] = {
+    // Common
+    { 0x004263d4, 0 }, // bind()
+    { 0x0042641b, 0 }, // bind()
+    { 0x004c9d2a, 0 }, // bind()
+    { 0x00ba36be, 0 }, // bind()
+    { 0x00e85ffa, 0 }, // bind()
+    { 0x00ba6e83, 2 }, // sendTo()
+    { 0x00c46a66, 3 }, // getAdapersInfo()
+    { 0x00ba714c, 4 }, // getHostByName()
+
+    // Server
+    { 0x00c465bd, 1 }, // connect()
+    { 0x004eca95, std::string_view("\xEB", 1), ".text", CodeEntry::INJECT_DATA, std::string_view("\x74", 1) }, // change JZ (74) to JMP (EB)
+    { 0x00ab3100, std::string_view("\xE9\xFB\xEE\xCF\x00", 5), ".text", CodeEntry::INJECT_DATA, std::string_view("\xE8\x4B\xBA\xFF\xFF", 5) }, // change function call to instead jump to the .text_mp section.
+    { std::string_view("\xE8\x4B\xCB\x2F\xFF"      // call   0xff2fcb50
+                       "\x51"                      // push   ecx
+                       "\x50"                      // push   eax
+                       "\xFF\x15\xA4\x0D\x7B\x01"  // call   DWORD PTR ds:0x17b0da4
+                       "\x8B\xC8"                  // mov    ecx,eax
+                       "\x58"                      // pop    eax
+                       "\x89\x48\x08"              // mov    DWORD PTR [eax+0x8],ecx
+                       "\x59"                      // pop    ecx
+                       "\xE9\xEC\x10\x30\xFF", 25) // jmp    0xff301105
+    }
+};
+constexpr PatchCode patch_table_server_uplay[] = {
+    // Common
+    { 0x004263d4, 0 }, // bind()
+    { 0x0042641b, 0 }, // bind()
+    { 0x004c9d2a, 0 }, // bind()
+    { 0x00ba36be, 0 }, // bind()
+    { 0x00e85ffa, 0 }, // bind()
+    { 0x00ba6e83, 2 }, // sendTo()
+    { 0x00c46a66, 3 }, // getAdapersInfo()
+    { 0x00ba714c, 4 }, // getHostByName()
+
+    // Server
+    { 0x00c465bd, 1 },  // connect()
+    { 0x004eca95, std::string_view("\xEB", 1), ".text", CodeEntry::INJECT_DATA, std::string_view("\x74", 1) }, // change JZ (74) to JMP (EB)
+    { 0x00ab3100, std::string_view("\xE9\xFB\xEE\xCF\x00", 5), ".text", CodeEntry::INJECT_DATA, std::string_view("\xE8\x4B\xBA\xFF\xFF", 5) } // change function call to instead jump to .text_mp section.
+};
+constexpr PatchTarget patch_table_server[] = {
+    { // Retail (GOG is identical)
+        "Retail",
+        "c175d2a1918d3e6d4120a2f6e6254bd04907a5ec10d3c1dfac28100d6fbf9ace"_sha256,
+        "bfb73dffcac987a511be8a7d34f66644e9171dc0fee6a48a17256d6b5e55dc64"_sha256,
+        patch_table_server_retail
+    },
+    { // Steam (R2 is identical)
+        "Steam",
+        "5cd5d7b6e6e0b1d25843fdee3e9a743ed10030e89ee109b121109f4a146a062e"_sha256,
+        "bfb73dffcac987a511be8a7d34f66644e9171dc0fee6a48a17256d6b5e55dc64"_sha256,
+        patch_table_server_steam
+    },
+    { // Uplay
+        "Uplay",
+        "948a8626276a6689c0125f2355b6a820c104f20dee36977973b39964a82f2703"_sha256,
+        "38f33dfd74b9483fb7db7703dffe61d61fa51444730d38ed2b61fc6e20855d9a"_sha256,
+        patch_table_server_uplay
+    }
+};
+
+constexpr PatchFile patch_tables[] = {
+    { "Dunia.dll", patch_table_dunia },
+    { "FC2ServerLauncher.exe", patch_table_server }
+};
+
+static_assert(!hasOverlappingCode(patch_tables), "Patch tables contain overlapping writes within a section.");
+static_assert(!hasDuplicateAddress(patch_tables), "Patch tables contain the same address more than once.");
+static_assert(!hasSymbolOutOfRange(patch_tables, patch_library_function_names.size()), "Patch tables reference a symbol outside of patch_library_functions.");
+static_assert(!hasInvalidSignature(patch_tables), "Patch tables contain a malformed signature.");
+
+// Runtime form of the compiled-in patch tables, only constructed on first use.
+inline const QList<FileEntry> &getBuiltInFiles()
+{
+    static const QList<FileEntry> files = [] {
+        QList<FileEntry> files;
+
+        for (const PatchFile &file : patch_tables) {
+            files.append(file.toFileEntry());
+        }
+
+        return files;
+    }();
+
+    return files;
+}
+
 #endif // GLOBAL_H
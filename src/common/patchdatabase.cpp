@@ -0,0 +1,267 @@
+#include <cstring>
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QtEndian>
+#include <QPair>
+#include <QDebug>
+
+#include "patchdatabase.h"
+#include "global.h"
+
+// Layout, all integers little endian:
+// header, file records, target records, code records, then the strings and data they point to by absolute offset.
+constexpr quint32 patch_database_magic = 0x44504346; // "FCPD"
+constexpr quint32 patch_database_version = 3;
+constexpr int patch_database_header_size = 32;
+constexpr int patch_database_file_record_size = 12;
+constexpr int patch_database_target_record_size = 76;
+constexpr int patch_database_code_record_size = 36;
+constexpr char patch_database_built_in_id[] = "builtin";
+
+const QList<FileEntry> &PatchDatabase::getFiles()
+{
+    return getTables().files;
+}
+
+QString PatchDatabase::getId()
+{
+    return getTables().id;
+}
+
+const PatchDatabase::Tables &PatchDatabase::getTables()
+{
+    static const Tables tables = [] {
+        Tables tables;
+
+        // Next to the patcher rather than wherever it was started from.
+        QString fileName = QDir(QCoreApplication::applicationDirPath()).filePath(app_patch_database_file);
+
+        // An external database takes precedence, so new editions can be added without rebuilding.
+        if (QFile::exists(fileName) && load(fileName, tables.files)) {
+            QFile file(fileName);
+
+            if (file.open(QFile::ReadOnly)) {
+                tables.id = QCryptographicHash::hash(file.readAll(), QCryptographicHash::Sha256).toHex();
+            }
+
+            return tables;
+        }
+
+        tables.files = getBuiltInFiles();
+        tables.id = patch_database_built_in_id;
+
+        return tables;
+    }();
+
+    return tables;
+}
+
+bool PatchDatabase::load(const QString &fileName, QList<FileEntry> &files)
+{
+    // Never unmapped, every entry loaded from it references the mapping.
+    QFile *file = new QFile(fileName);
+    const uchar *data = file->open(QFile::ReadOnly) ? file->map(0, file->size()) : nullptr;
+
+    if (!data || !parse(data, file->size(), files)) {
+        qDebug().noquote() << QT_TR_NOOP(QString("Error: Invalid patch database %1, using built-in patch tables.").arg(fileName));
+        delete file;
+        files.clear();
+
+        return false;
+    }
+
+    qDebug().noquote() << QT_TR_NOOP(QString("Loaded %1 files from patch database %2").arg(files.length()).arg(fileName));
+
+    return true;
+}
+
+bool PatchDatabase::parse(const uchar *data, qint64 size, QList<FileEntry> &files)
+{
+    if (size < patch_database_header_size || qFromLittleEndian<quint32>(data) != patch_database_magic || qFromLittleEndian<quint32>(data + 4) != patch_database_version) {
+        return false;
+    }
+
+    quint32 fileCount = qFromLittleEndian<quint32>(data + 8);
+    quint32 fileOffset = qFromLittleEndian<quint32>(data + 12);
+    quint32 targetCount = qFromLittleEndian<quint32>(data + 16);
+    quint32 targetOffset = qFromLittleEndian<quint32>(data + 20);
+    quint32 codeCount = qFromLittleEndian<quint32>(data + 24);
+    quint32 codeOffset = qFromLittleEndian<quint32>(data + 28);
+
+    auto isInside = [size](quint64 offset, quint64 length) {
+        return offset <= static_cast<quint64>(size) && length <= static_cast<quint64>(size) - offset;
+    };
+
+    if (!isInside(fileOffset, static_cast<quint64>(fileCount) * patch_database_file_record_size) ||
+        !isInside(targetOffset, static_cast<quint64>(targetCount) * patch_database_target_record_size) ||
+        !isInside(codeOffset, static_cast<quint64>(codeCount) * patch_database_code_record_size)) {
+        return false;
+    }
+
+    // Strings are referenced in place, so they have to be terminated inside the file.
+    auto getString = [data, size](quint32 offset) -> const char* {
+        if (offset >= size || !std::memchr(data + offset, '\0', size - offset)) {
+            return nullptr;
+        }
+
+        return reinterpret_cast<const char*>(data + offset);
+    };
+
+    auto getData = [data, &isInside](quint32 offset, quint32 length, QByteArray &result) {
+        if (!isInside(offset, length)) {
+            return false;
+        }
+
+        result = QByteArray::fromRawData(reinterpret_cast<const char*>(data + offset), length);
+
+        return true;
+    };
+
+    auto getCheckSum = [](const uchar *checkSumPtr) {
+        CheckSum checkSum {};
+        std::memcpy(checkSum.data(), checkSumPtr, checkSum.size());
+
+        return checkSum;
+    };
+
+    for (quint32 i = 0; i < fileCount; i++) {
+        const uchar *fileRecord = data + fileOffset + i * patch_database_file_record_size;
+        const char *fileName = getString(qFromLittleEndian<quint32>(fileRecord));
+        quint32 firstTarget = qFromLittleEndian<quint32>(fileRecord + 4);
+        quint32 fileTargetCount = qFromLittleEndian<quint32>(fileRecord + 8);
+
+        if (!fileName || firstTarget > targetCount || fileTargetCount > targetCount - firstTarget) {
+            return false;
+        }
+
+        QList<TargetEntry> targets;
+
+        for (quint32 j = firstTarget; j < firstTarget + fileTargetCount; j++) {
+            const uchar *targetRecord = data + targetOffset + j * patch_database_target_record_size;
+            const char *targetName = getString(qFromLittleEndian<quint32>(targetRecord));
+            quint32 firstCode = qFromLittleEndian<quint32>(targetRecord + 68);
+            quint32 targetCodeCount = qFromLittleEndian<quint32>(targetRecord + 72);
+
+            if (!targetName || firstCode > codeCount || targetCodeCount > codeCount - firstCode) {
+                return false;
+            }
+
+            QList<CodeEntry> codeEntries;
+
+            for (quint32 k = firstCode; k < firstCode + targetCodeCount; k++) {
+                const uchar *codeRecord = data + codeOffset + k * patch_database_code_record_size;
+                quint32 type = qFromLittleEndian<quint32>(codeRecord + 4);
+                const char *section = getString(qFromLittleEndian<quint32>(codeRecord + 8));
+                const char *signature = getString(qFromLittleEndian<quint32>(codeRecord + 28));
+                QByteArray codeData;
+                QByteArray originalData;
+
+                if (type > CodeEntry::NEW_DATA || !section || !signature ||
+                    !getData(qFromLittleEndian<quint32>(codeRecord + 12), qFromLittleEndian<quint32>(codeRecord + 16), codeData) ||
+                    !getData(qFromLittleEndian<quint32>(codeRecord + 20), qFromLittleEndian<quint32>(codeRecord + 24), originalData)) {
+                    return false;
+                }
+
+                codeEntries.append(CodeEntry(qFromLittleEndian<quint32>(codeRecord), codeData, QString::fromLatin1(section), static_cast<CodeEntry::Type>(type), originalData,
+                                             QByteArray::fromRawData(signature, static_cast<int>(qstrlen(signature))), qFromLittleEndian<qint32>(codeRecord + 32)));
+            }
+
+            targets.append(TargetEntry(targetName, getCheckSum(targetRecord + 4), getCheckSum(targetRecord + 36), codeEntries));
+        }
+
+        files.append(FileEntry(fileName, targets));
+    }
+
+    return true;
+}
+
+bool PatchDatabase::write(const QString &fileName, const QList<FileEntry> &files)
+{
+    QByteArray fileRecords;
+    QByteArray targetRecords;
+    QByteArray codeRecords;
+    QByteArray heap;
+    QList<QPair<QByteArray*, int>> heapReferences; // Record offsets that still need the start of the heap added.
+    quint32 targetCount = 0;
+    quint32 codeCount = 0;
+
+    auto appendUInt32 = [](QByteArray &record, quint32 value) {
+        char buffer[sizeof(quint32)];
+        qToLittleEndian(value, buffer);
+        record.append(buffer, sizeof(buffer));
+    };
+
+    auto appendHeap = [&heap, &heapReferences, &appendUInt32](QByteArray &record, const QByteArray &value) {
+        heapReferences.append({ &record, record.length() });
+        appendUInt32(record, heap.length());
+        heap.append(value);
+    };
+
+    for (const FileEntry &fileEntry : files) {
+        const QList<TargetEntry> &targets = fileEntry.getTargets();
+
+        appendHeap(fileRecords, QByteArray(fileEntry.getName()) + '\0');
+        appendUInt32(fileRecords, targetCount);
+        appendUInt32(fileRecords, targets.length());
+
+        for (const TargetEntry &target : targets) {
+            const QList<CodeEntry> &codeEntries = target.getCodeEntries();
+
+            appendHeap(targetRecords, QByteArray(target.getName()) + '\0');
+            targetRecords.append(reinterpret_cast<const char*>(target.getCheckSum().data()), sizeof(CheckSum));
+            targetRecords.append(reinterpret_cast<const char*>(target.getCheckSumPatched().data()), sizeof(CheckSum));
+            appendUInt32(targetRecords, codeCount);
+            appendUInt32(targetRecords, codeEntries.length());
+
+            for (const CodeEntry &codeEntry : codeEntries) {
+                appendUInt32(codeRecords, codeEntry.getAddress());
+                appendUInt32(codeRecords, codeEntry.getType());
+                appendHeap(codeRecords, codeEntry.getSection().toLatin1() + '\0');
+                appendHeap(codeRecords, codeEntry.getData());
+                appendUInt32(codeRecords, codeEntry.getData().length());
+                appendHeap(codeRecords, codeEntry.getOriginalData());
+                appendUInt32(codeRecords, codeEntry.getOriginalData().length());
+                appendHeap(codeRecords, codeEntry.getSignature() + '\0');
+                appendUInt32(codeRecords, codeEntry.getSignatureOffset());
+            }
+
+            targetCount++;
+            codeCount += codeEntries.length();
+        }
+    }
+
+    quint32 fileOffset = patch_database_header_size;
+    quint32 targetOffset = fileOffset + fileRecords.length();
+    quint32 codeOffset = targetOffset + targetRecords.length();
+    quint32 heapOffset = codeOffset + codeRecords.length();
+
+    // Heap offsets were relative while building, make them absolute now that the layout is known.
+    for (const QPair<QByteArray*, int> &reference : heapReferences) {
+        char *offsetPtr = reference.first->data() + reference.second;
+        qToLittleEndian<quint32>(qFromLittleEndian<quint32>(offsetPtr) + heapOffset, offsetPtr);
+    }
+
+    QByteArray header;
+    appendUInt32(header, patch_database_magic);
+    appendUInt32(header, patch_database_version);
+    appendUInt32(header, files.length());
+    appendUInt32(header, fileOffset);
+    appendUInt32(header, targetCount);
+    appendUInt32(header, targetOffset);
+    appendUInt32(header, codeCount);
+    appendUInt32(header, codeOffset);
+
+    QSaveFile file(fileName);
+
+    if (!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+
+    file.write(header + fileRecords + targetRecords + codeRecords + heap);
+
+    return file.commit();
+}
@@ -0,0 +1,30 @@
+#ifndef PATCHDATABASE_H
+#define PATCHDATABASE_H
+
+#include <QString>
+#include <QList>
+
+#include "entry.h"
+
+// Patch tables in effect, loaded from an external database file next to the patcher when there is one and the compiled-in tables otherwise.
+// The database is mapped and names and code bytes point straight into the mapping, so it stays mapped for the lifetime of the process.
+// It is a load-and-convert format, the records are turned into the same entry lists as the compiled-in tables once on first use.
+class PatchDatabase
+{
+public:
+    static const QList<FileEntry> &getFiles();
+    static QString getId();
+    static bool load(const QString &fileName, QList<FileEntry> &files);
+    static bool write(const QString &fileName, const QList<FileEntry> &files);
+
+private:
+    struct Tables {
+        QList<FileEntry> files;
+        QString id; // Digest of the database in use, so anything derived from the tables can tell when they change.
+    };
+
+    static const Tables &getTables();
+    static bool parse(const uchar *data, qint64 size, QList<FileEntry> &files);
+};
+
+#endif // PATCHDATABASE_H
@@ -0,0 +1,287 @@
+#ifndef PATCHTABLE_H
+#define PATCHTABLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+
+#include "checksum.h"
+#include "entry.h"
+
+// Read-only view of a constexpr array, std::span is not available before C++20.
+template<typename T>
+class PatchSpan {
+public:
+    constexpr PatchSpan() = default;
+
+    template<std::size_t N>
+    constexpr PatchSpan(const T (&array)[N]) :
+        first(array),
+        count(N) {}
+
+    constexpr const T *begin() const {
+        return first;
+    }
+
+    constexpr const T *end() const {
+        return first + count;
+    }
+
+    constexpr std::size_t size() const {
+        return count;
+    }
+
+    constexpr const T &operator[](std::size_t index) const {
+        return first[index];
+    }
+
+private:
+    const T *first = nullptr;
+    std::size_t count = 0;
+};
+
+// Compile-time counterpart of CodeEntry, with the same constructors.
+class PatchCode {
+public:
+    constexpr PatchCode(uint32_t address, uint32_t symbol, std::string_view signature = std::string_view(), int signatureOffset = 0) :
+        address(address),
+        symbol(symbol),
+        signature(signature),
+        signatureOffset(signatureOffset),
+        section(".text"),
+        type(CodeEntry::INJECT_SYMBOL) {}
+
+    constexpr PatchCode(uint32_t address, std::string_view data, std::string_view section = ".text", CodeEntry::Type type = CodeEntry::INJECT_DATA, std::string_view originalData = std::string_view(), std::string_view signature = std::string_view(), int signatureOffset = 0) :
+        address(address),
+        data(data),
+        originalData(originalData),
+        signature(signature),
+        signatureOffset(signatureOffset),
+        section(section),
+        type(type) {}
+
+    constexpr PatchCode(std::string_view data, std::string_view section = ".text_mp") :
+        data(data),
+        section(section),
+        type(CodeEntry::NEW_DATA) {}
+
+    constexpr uint32_t getAddress() const {
+        return address;
+    }
+
+    constexpr uint32_t getSymbol() const {
+        return symbol;
+    }
+
+    constexpr std::string_view getSignature() const {
+        return signature;
+    }
+
+    constexpr int getSignatureOffset() const {
+        return signatureOffset;
+    }
+
+    constexpr std::string_view getSection() const {
+        return section;
+    }
+
+    constexpr CodeEntry::Type getType() const {
+        return type;
+    }
+
+    // Number of bytes written at the address, symbols are replaced by a 32-bit address.
+    constexpr std::size_t getLength() const {
+        return type == CodeEntry::INJECT_SYMBOL ? sizeof(uint32_t) : data.size();
+    }
+
+    // Only code with an address patches bytes of an existing section.
+    constexpr bool isInjected() const {
+        return address != 0 && type != CodeEntry::NEW_DATA;
+    }
+
+    CodeEntry toCodeEntry() const {
+        QString sectionName = QString::fromLatin1(section.data(), static_cast<int>(section.size()));
+
+        if (type == CodeEntry::INJECT_SYMBOL) {
+            return CodeEntry(address, symbol, sectionName, type, toByteArray(signature), signatureOffset);
+        }
+
+        return CodeEntry(address, toByteArray(data), sectionName, type, toByteArray(originalData), toByteArray(signature), signatureOffset);
+    }
+
+private:
+    uint32_t address = 0;
+    uint32_t symbol = 0;
+    std::string_view data;
+    std::string_view originalData;
+    std::string_view signature;
+    int signatureOffset = 0;
+    std::string_view section;
+    CodeEntry::Type type;
+
+    // Backed by string literals, so no need to copy the bytes.
+    static QByteArray toByteArray(std::string_view value) {
+        return QByteArray::fromRawData(value.data(), static_cast<int>(value.size()));
+    }
+};
+
+class PatchTarget {
+public:
+    constexpr PatchTarget(const char *name, const CheckSum &checkSum, const CheckSum &checkSumPatched, PatchSpan<PatchCode> codes) :
+        name(name),
+        checkSum(checkSum),
+        checkSumPatched(checkSumPatched),
+        codes(codes) {}
+
+    constexpr PatchSpan<PatchCode> getCodes() const {
+        return codes;
+    }
+
+    TargetEntry toTargetEntry() const {
+        QList<CodeEntry> codeEntries;
+        codeEntries.reserve(static_cast<int>(codes.size()));
+
+        for (const PatchCode &code : codes) {
+            codeEntries.append(code.toCodeEntry());
+        }
+
+        return TargetEntry(name, checkSum, checkSumPatched, codeEntries);
+    }
+
+private:
+    const char *name;
+    CheckSum checkSum;
+    CheckSum checkSumPatched;
+    PatchSpan<PatchCode> codes;
+};
+
+class PatchFile {
+public:
+    constexpr PatchFile(const char *name, PatchSpan<PatchTarget> targets) :
+        name(name),
+        targets(targets) {}
+
+    constexpr PatchSpan<PatchTarget> getTargets() const {
+        return targets;
+    }
+
+    FileEntry toFileEntry() const {
+        QList<TargetEntry> targetEntries;
+        targetEntries.reserve(static_cast<int>(targets.size()));
+
+        for (const PatchTarget &target : targets) {
+            targetEntries.append(target.toTargetEntry());
+        }
+
+        return FileEntry(name, targetEntries);
+    }
+
+private:
+    const char *name;
+    PatchSpan<PatchTarget> targets;
+};
+
+// Two writes to the same bytes would make the result depend on the order they are applied in.
+constexpr bool hasOverlappingCode(PatchSpan<PatchFile> files)
+{
+    for (const PatchFile &file : files) {
+        for (const PatchTarget &target : file.getTargets()) {
+            PatchSpan<PatchCode> codes = target.getCodes();
+
+            for (std::size_t i = 0; i < codes.size(); i++) {
+                for (std::size_t j = i + 1; j < codes.size(); j++) {
+                    const PatchCode &a = codes[i];
+                    const PatchCode &b = codes[j];
+
+                    if (a.isInjected() && b.isInjected() && a.getSection() == b.getSection() &&
+                        a.getAddress() < b.getAddress() + b.getLength() && b.getAddress() < a.getAddress() + a.getLength()) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+constexpr bool hasDuplicateAddress(PatchSpan<PatchFile> files)
+{
+    for (const PatchFile &file : files) {
+        for (const PatchTarget &target : file.getTargets()) {
+            PatchSpan<PatchCode> codes = target.getCodes();
+
+            for (std::size_t i = 0; i < codes.size(); i++) {
+                for (std::size_t j = i + 1; j < codes.size(); j++) {
+                    if (codes[i].getAddress() != 0 && codes[i].getAddress() == codes[j].getAddress()) {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+constexpr bool hasSymbolOutOfRange(PatchSpan<PatchFile> files, std::size_t symbolCount)
+{
+    for (const PatchFile &file : files) {
+        for (const PatchTarget &target : file.getTargets()) {
+            for (const PatchCode &code : target.getCodes()) {
+                if (code.getType() == CodeEntry::INJECT_SYMBOL && code.getSymbol() >= symbolCount) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+// Signatures are pairs of hex digits or "??" wildcards separated by spaces, with at least one fixed byte.
+// The bytes that get patched must be wildcards, otherwise the signature no longer matches a patched file.
+constexpr bool isValidSignature(std::string_view signature, std::size_t offset, std::size_t length)
+{
+    bool hasFixedByte = false;
+
+    for (std::size_t i = 0; i < signature.size(); i += 3) {
+        if (i + 2 > signature.size() || (i + 2 < signature.size() && signature[i + 2] != ' ')) {
+            return false;
+        }
+
+        bool wildcard = signature[i] == '?' && signature[i + 1] == '?';
+        auto isHex = [](char character) {
+            return (character >= '0' && character <= '9') || (character >= 'a' && character <= 'f') || (character >= 'A' && character <= 'F');
+        };
+
+        if (!wildcard && (!(isHex(signature[i]) && isHex(signature[i + 1])) || (i / 3 >= offset && i / 3 < offset + length))) {
+            return false;
+        }
+
+        hasFixedByte |= !wildcard;
+    }
+
+    return hasFixedByte;
+}
+
+constexpr bool hasInvalidSignature(PatchSpan<PatchFile> files)
+{
+    for (const PatchFile &file : files) {
+        for (const PatchTarget &target : file.getTargets()) {
+            for (const PatchCode &code : target.getCodes()) {
+                if (!code.getSignature().empty() && (code.getSignatureOffset() < 0 || !isValidSignature(code.getSignature(), code.getSignatureOffset(), code.getLength()))) {
+                    return true;
+                }
+            }
+        }
+    }
+
+    return false;
+}
+
+#endif // PATCHTABLE_H
@@ -0,0 +1,9 @@
+# Synthetic game binaries for exercising the patch pipeline without the real game files.
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+HEADERS += \
+    $$PWD/fixturegenerator.h
+
+SOURCES += \
+    $$PWD/fixturegenerator.cpp
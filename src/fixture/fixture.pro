@@ -0,0 +1,23 @@
+QT -= gui
+
+TARGET = fc2mppatcher-fixture
+TEMPLATE = app
+CONFIG += \
+        c++17 \
+        console \
+        static
+CONFIG -= app_bundle
+
+DEFINES += QT_DEPRECATED_WARNINGS
+DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+SOURCES += main.cpp
+
+include(fixture.pri)
+include(../common/common.pri)
+
+# Including 3rd party PeBliss library.
+INCLUDEPATH += $$PWD/../../lib/libpebliss/pe_lib
+DEPENDPATH += $$PWD/../../lib/libpebliss/pe_lib
+
+LIBS += -L$$PWD/../../lib/libpebliss/lib -lpebliss
@@ -0,0 +1,355 @@
+#include <fstream>
+#include <random>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <QDebug>
+#include <QtEndian>
+
+#include <pe_bliss.h>
+
+#include "fixturegenerator.h"
+#include "global.h"
+#include "patchdatabase.h"
+
+using namespace pe_bliss;
+
+constexpr quint32 fixture_section_alignment = 0x1000;
+constexpr quint32 fixture_seed = 0x46433221;
+constexpr quint32 fixture_dll_image_base = 0x10000000;
+constexpr quint32 fixture_exe_image_base = 0x00400000;
+
+// Space PeFile::apply() needs for the patch library import section in front of .text_mp.
+constexpr quint32 fixture_import_section_reserve = fixture_section_alignment;
+
+static quint32 alignUp(quint32 value, quint32 alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static quint32 alignDown(quint32 value, quint32 alignment)
+{
+    return value & ~(alignment - 1);
+}
+
+bool FixtureGenerator::generateInstall(const QDir &dir, int targetIndex, qint64 size)
+{
+    QDir binDir = dir;
+
+    if (!binDir.mkpath(game_executable_directory) || !binDir.cd(game_executable_directory)) {
+        return false;
+    }
+
+    // Editions are listed in the same order for every file.
+    for (const FileEntry &fileEntry : PatchDatabase::getFiles()) {
+        const QList<TargetEntry> &targets = fileEntry.getTargets();
+
+        if (targetIndex < 0 || targetIndex >= targets.length()) {
+            return false;
+        }
+
+        if (!generate(binDir.filePath(fileEntry.getName()), fileEntry, targets[targetIndex], size)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool FixtureGenerator::generate(const QString &fileName, const FileEntry &fileEntry, const TargetEntry &target, qint64 size)
+{
+    bool dll = QString(fileEntry.getName()).endsWith(".dll", Qt::CaseInsensitive);
+    quint32 imageBase = getImageBase(fileEntry);
+    QList<Range> ranges = getSectionRanges(target, imageBase);
+
+    // Images with a .text_mp trampoline jump to a fixed address, so the image has to end right where PeFile::apply() puts it.
+    quint32 patchSectionAddress = getPatchSectionAddress(target, imageBase, ranges);
+    quint32 imageEnd = patchSectionAddress ? patchSectionAddress - imageBase - fixture_import_section_reserve : 0;
+
+    try {
+        pe_base image(pe_properties_32(), fixture_section_alignment, dll);
+        image.set_image_base(imageBase);
+
+        std::mt19937 random(fixture_seed);
+        quint32 nextRva = fixture_section_alignment;
+
+        auto addSection = [&](const QString &name, quint32 start, quint32 rawSize) -> section& {
+            // The previous section spans the gap up to this one.
+            if (!image.get_image_sections().empty()) {
+                section &previous = image.get_image_sections().back();
+                image.set_section_virtual_size(previous, start - previous.get_virtual_address());
+            }
+
+            std::string rawData(rawSize, '\0');
+            std::generate(rawData.begin(), rawData.end(), [&random] {
+                return static_cast<char>(random());
+            });
+
+            section newSection;
+            newSection.set_name(name.toStdString());
+            newSection.readable(true);
+
+            if (name == ".text") {
+                newSection.executable(true);
+            } else if (name != ".rdata") {
+                newSection.writeable(true);
+            }
+
+            newSection.set_raw_data(rawData);
+            nextRva = start + rawSize;
+
+            return image.add_section(newSection);
+        };
+
+        // Sections start on the alignment boundary below their first site, but never overlap the previous one.
+        QList<quint32> starts;
+        QList<quint32> rawSizes;
+
+        for (const Range &range : ranges) {
+            quint32 start = qMax(nextRva, alignDown(range.begin, fixture_section_alignment));
+
+            if (range.begin < start) {
+                qDebug().noquote() << QString("Error: Section \"%1\" cannot be laid out.").arg(range.name);
+
+                return false;
+            }
+
+            starts.append(start);
+            rawSizes.append(alignUp(range.end - start, fixture_section_alignment));
+            nextRva = start + rawSizes.last();
+        }
+
+        // A pinned image cannot grow at the end, so .text and .rdata fill the gap up to the next section instead.
+        if (imageEnd && size > 0) {
+            qint64 gaps = 0;
+
+            for (int i = 0; i < ranges.length() - 1; i++) {
+                gaps += starts[i + 1] - starts[i] - rawSizes[i];
+            }
+
+            qint64 missing = size - (imageEnd - gaps);
+
+            for (int i = 0; i < ranges.length() - 1 && missing > 0; i++) {
+                if (ranges[i].name != ".text" && ranges[i].name != ".rdata") {
+                    continue;
+                }
+
+                quint32 growth = qMin<qint64>(starts[i + 1] - starts[i] - rawSizes[i], alignUp(static_cast<quint32>(missing), fixture_section_alignment));
+                rawSizes[i] += growth;
+                missing -= growth;
+            }
+
+            if (missing > 0) {
+                qDebug().noquote() << QString("Error: Image has to end at 0x%1 and cannot be scaled to %2 bytes.").arg(imageBase + imageEnd, 0, 16).arg(size);
+
+                return false;
+            }
+        }
+
+        for (int i = 0; i < ranges.length(); i++) {
+            addSection(ranges[i].name, starts[i], rawSizes[i]);
+        }
+
+        // Import the functions the patch replaces, so every symbol site has a real import slot to point at.
+        imported_functions_list imports;
+
+        for (const QPair<QString, QString> &function : patch_library_original_functions) {
+            imported_functions_list::iterator iterator = std::find_if(imports.begin(), imports.end(), [&](const import_library &library) {
+                return library.get_name() == function.first.toStdString();
+            });
+
+            if (iterator == imports.end()) {
+                import_library library;
+                library.set_name(function.first.toStdString());
+                imports.push_back(library);
+                iterator = imports.end() - 1;
+            }
+
+            imported_function importFunction;
+            importFunction.set_name(function.second.toStdString());
+            iterator->add_import(importFunction);
+        }
+
+        section importSection;
+        importSection.get_raw_data().resize(1); // We cannot add empty sections, so let it be the initial data size 1.
+        importSection.set_name(".idata");
+        importSection.readable(true).writeable(true);
+        section &attachedSection = image.add_section(importSection);
+        rebuild_imports(image, imports, attachedSection, import_rebuilder_settings(true, false));
+        nextRva = alignUp(attachedSection.get_virtual_address() + attachedSection.get_virtual_size(), fixture_section_alignment);
+
+        // Resolve where each replaced function ended up in the import address table.
+        QList<quint32> slotAddresses;
+        quint32 iatBegin = std::numeric_limits<quint32>::max();
+        quint32 iatEnd = 0;
+
+        for (const import_library &library : get_imported_functions(image)) {
+            iatBegin = qMin(iatBegin, library.get_rva_to_iat());
+            iatEnd = qMax<quint32>(iatEnd, library.get_rva_to_iat() + (library.get_imported_functions().size() + 1) * sizeof(quint32));
+        }
+
+        for (const QPair<QString, QString> &function : patch_library_original_functions) {
+            for (const import_library &library : get_imported_functions(image)) {
+                if (library.get_name() != function.first.toStdString()) {
+                    continue;
+                }
+
+                const import_library::imported_list &functions = library.get_imported_functions();
+
+                for (unsigned int i = 0; i < functions.size(); i++) {
+                    if (functions[i].get_name() == function.second.toStdString()) {
+                        slotAddresses.append(imageBase + library.get_rva_to_iat() + i * sizeof(quint32));
+                    }
+                }
+            }
+        }
+
+        // Like the linker does, publish the import address tables so original call sites can be told apart.
+        image.set_directory_rva(pe_win::image_directory_entry_iat, iatBegin);
+        image.set_directory_size(pe_win::image_directory_entry_iat, iatEnd - iatBegin);
+
+        // Padding section which either scales the image up to the requested size or ends it at the pinned address.
+        quint32 paddingSize;
+
+        if (imageEnd) {
+            if (imageEnd <= nextRva) {
+                qDebug().noquote() << QString("Error: Image cannot end at 0x%1.").arg(imageBase + imageEnd, 0, 16);
+
+                return false;
+            }
+
+            paddingSize = imageEnd - nextRva;
+        } else {
+            paddingSize = alignUp(static_cast<quint32>(qMax<qint64>(size - nextRva, 1)), fixture_section_alignment);
+        }
+
+        addSection(".data", nextRva, paddingSize);
+
+        // Lay out the original bytes at every patch site.
+        for (const CodeEntry &codeEntry : target.getCodeEntries()) {
+            if (codeEntry.getType() == CodeEntry::NEW_DATA || codeEntry.getAddress() == 0) {
+                continue;
+            }
+
+            quint32 rva = codeEntry.getAddress() - imageBase;
+            section &codeSection = image.section_from_rva(rva);
+            std::string &rawData = codeSection.get_raw_data();
+            quint32 offset = rva - codeSection.get_virtual_address();
+
+            if (codeEntry.getType() == CodeEntry::INJECT_SYMBOL) {
+                int index = codeEntry.getData().toInt();
+
+                if (index >= slotAddresses.length()) {
+                    continue;
+                }
+
+                quint32 slotAddress = qToLittleEndian(slotAddresses[index]);
+
+                // call dword ptr [slot]
+                rawData[offset - 2] = '\xFF';
+                rawData[offset - 1] = '\x15';
+                std::memcpy(&rawData[offset], &slotAddress, sizeof(slotAddress));
+            } else {
+                QByteArray data = codeEntry.getOriginalData();
+
+                // Without known original bytes, anything but the patched bytes will do.
+                if (data.isEmpty()) {
+                    data = codeEntry.getData();
+
+                    for (char &character : data) {
+                        character = static_cast<char>(~character);
+                    }
+                }
+
+                std::memcpy(&rawData[offset], data.constData(), data.length());
+            }
+        }
+
+        std::ofstream outputStream(fileName.toStdString(), std::ios::out | std::ios::binary | std::ios::trunc);
+
+        if (!outputStream) {
+            qDebug().noquote() << QString("Cannot create: %1").arg(fileName);
+
+            return false;
+        }
+
+        rebuild_pe(image, outputStream);
+    } catch (const pe_exception &exception) {
+        qDebug().noquote() << QString("Error: %1").arg(exception.what());
+
+        return false;
+    }
+
+    qDebug().noquote() << QString("Generated fixture %1").arg(fileName);
+
+    return true;
+}
+
+quint32 FixtureGenerator::getImageBase(const FileEntry &fileEntry)
+{
+    // Default image bases of the linker, which is also what the game binaries use.
+    return QString(fileEntry.getName()).endsWith(".dll", Qt::CaseInsensitive) ? fixture_dll_image_base : fixture_exe_image_base;
+}
+
+QList<FixtureGenerator::Range> FixtureGenerator::getSectionRanges(const TargetEntry &target, quint32 imageBase)
+{
+    QList<Range> ranges;
+
+    // Find the address range every section needs to cover, symbol sites also need their call opcode in front.
+    for (const CodeEntry &codeEntry : target.getCodeEntries()) {
+        if (codeEntry.getType() == CodeEntry::NEW_DATA || codeEntry.getAddress() == 0) {
+            continue;
+        }
+
+        bool symbol = codeEntry.getType() == CodeEntry::INJECT_SYMBOL;
+        quint32 begin = codeEntry.getAddress() - imageBase - (symbol ? 2 : 0);
+        quint32 end = codeEntry.getAddress() - imageBase + (symbol ? sizeof(quint32) : codeEntry.getData().length());
+        QList<Range>::iterator iterator = std::find_if(ranges.begin(), ranges.end(), [&](const Range &range) {
+            return range.name == codeEntry.getSection();
+        });
+
+        if (iterator == ranges.end()) {
+            ranges.append({ codeEntry.getSection(), begin, end });
+        } else {
+            iterator->begin = qMin(iterator->begin, begin);
+            iterator->end = qMax(iterator->end, end);
+        }
+    }
+
+    std::sort(ranges.begin(), ranges.end(), [](const Range &a, const Range &b) {
+        return a.begin < b.begin;
+    });
+
+    return ranges;
+}
+
+quint32 FixtureGenerator::getPatchSectionAddress(const TargetEntry &target, quint32 imageBase, const QList<Range> &ranges)
+{
+    bool hasNewData = false;
+
+    for (const CodeEntry &codeEntry : target.getCodeEntries()) {
+        hasNewData |= codeEntry.getType() == CodeEntry::NEW_DATA;
+    }
+
+    if (!hasNewData || ranges.isEmpty()) {
+        return 0;
+    }
+
+    // The trampoline is entered through a relative jmp or call whose destination lies beyond every existing section.
+    for (const CodeEntry &codeEntry : target.getCodeEntries()) {
+        const QByteArray &data = codeEntry.getData();
+
+        if (codeEntry.getType() != CodeEntry::INJECT_DATA || data.length() != 5 || (data[0] != '\xE9' && data[0] != '\xE8')) {
+            continue;
+        }
+
+        quint32 destination = codeEntry.getAddress() + data.length() + qFromLittleEndian<quint32>(data.constData() + 1);
+
+        if (destination - imageBase >= ranges.last().end) {
+            return destination;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,29 @@
+#ifndef FIXTUREGENERATOR_H
+#define FIXTUREGENERATOR_H
+
+#include <QString>
+#include <QDir>
+#include <QList>
+
+#include "entry.h"
+
+// Generates PE32 images laid out like the game binaries in the files table, so the patch pipeline can run without them.
+class FixtureGenerator
+{
+public:
+    static bool generate(const QString &fileName, const FileEntry &fileEntry, const TargetEntry &target, qint64 size = 0);
+    static bool generateInstall(const QDir &dir, int targetIndex, qint64 size = 0);
+
+private:
+    struct Range {
+        QString name;
+        quint32 begin;
+        quint32 end;
+    };
+
+    static quint32 getImageBase(const FileEntry &fileEntry);
+    static QList<Range> getSectionRanges(const TargetEntry &target, quint32 imageBase);
+    static quint32 getPatchSectionAddress(const TargetEntry &target, quint32 imageBase, const QList<Range> &ranges);
+};
+
+#endif // FIXTUREGENERATOR_H
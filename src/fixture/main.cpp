@@ -0,0 +1,54 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+
+#include "global.h"
+#include "patchdatabase.h"
+#include "fixturegenerator.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    app.setOrganizationName(app_organization);
+    app.setApplicationName(QString("%1 Fixture").arg(app_name));
+    app.setApplicationVersion(APP_VERSION);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Generates synthetic game installs laid out like every edition in the patch table.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("directory", "Directory to create the installs in, one subdirectory per edition.");
+    parser.addOption({ "edition", "Only generate the edition with this index in the patch table.", "index" });
+    parser.addOption({ "size", "Minimum size of each image in bytes.", "bytes", "0" });
+    parser.process(app);
+
+    const QStringList arguments = parser.positionalArguments();
+
+    if (arguments.length() != 1) {
+        parser.showHelp(1);
+    }
+
+    QDir dir = arguments.first();
+    qint64 size = parser.value("size").toLongLong();
+    int editions = 0;
+
+    for (const FileEntry &fileEntry : PatchDatabase::getFiles()) {
+        editions = qMax(editions, fileEntry.getTargets().length());
+    }
+
+    for (int i = 0; i < editions; i++) {
+        if (parser.isSet("edition") && parser.value("edition").toInt() != i) {
+            continue;
+        }
+
+        QDir installDir = dir;
+
+        if (!installDir.mkpath(QString::number(i)) || !installDir.cd(QString::number(i)) || !FixtureGenerator::generateInstall(installDir, i, size)) {
+            qWarning().noquote() << QString("Error: Could not generate edition %1.").arg(i);
+
+            return 1;
+        }
+    }
+
+    return 0;
+}